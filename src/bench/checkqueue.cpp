@@ -0,0 +1,80 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "checkqueue.h"
+#include "crypto/sha256.h"
+
+#include <cstring>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// Shaped like ConnectBlock's use of the script check queue: one Add per
+// transaction, each with a few inputs, then a single Wait.
+static const int BATCHES_PER_BLOCK = 500;
+static const int MAX_CHECKS_PER_BATCH = 4;
+static const unsigned int BATCH_SIZE = 128;
+
+// A check doing a fixed amount of hashing, standing in for a script check.
+struct CFakeCheck
+{
+    unsigned char data[64];
+
+    CFakeCheck() { memset(data, 0, sizeof(data)); }
+
+    bool operator()()
+    {
+        unsigned char hash[CSHA256::OUTPUT_SIZE];
+        for (int i = 0; i < 20; i++)
+            CSHA256().Write(data, sizeof(data)).Finalize(hash);
+        return true;
+    }
+
+    void swap(CFakeCheck& x) { std::swap(data, x.data); }
+};
+
+static void CheckQueueThread(CCheckQueue<CFakeCheck>* pqueue)
+{
+    pqueue->Thread();
+}
+
+static void CheckQueueSpeed(benchmark::State& state, unsigned int nThreads)
+{
+    CCheckQueue<CFakeCheck> queue(BATCH_SIZE, nThreads);
+    boost::thread_group threads;
+    for (unsigned int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&CheckQueueThread, &queue));
+
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CFakeCheck> control(&queue);
+        for (int i = 0; i < BATCHES_PER_BLOCK; i++) {
+            std::vector<CFakeCheck> vChecks(1 + i % MAX_CHECKS_PER_BATCH);
+            control.Add(vChecks);
+        }
+        bool fOk = control.Wait();
+        assert(fOk);
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+static void CheckQueueSpeed_1Thread(benchmark::State& state) { CheckQueueSpeed(state, 1); }
+static void CheckQueueSpeed_2Threads(benchmark::State& state) { CheckQueueSpeed(state, 2); }
+static void CheckQueueSpeed_4Threads(benchmark::State& state) { CheckQueueSpeed(state, 4); }
+static void CheckQueueSpeed_8Threads(benchmark::State& state) { CheckQueueSpeed(state, 8); }
+static void CheckQueueSpeed_16Threads(benchmark::State& state) { CheckQueueSpeed(state, 16); }
+static void CheckQueueSpeed_32Threads(benchmark::State& state) { CheckQueueSpeed(state, 32); }
+static void CheckQueueSpeed_64Threads(benchmark::State& state) { CheckQueueSpeed(state, 64); }
+
+BENCHMARK(CheckQueueSpeed_1Thread);
+BENCHMARK(CheckQueueSpeed_2Threads);
+BENCHMARK(CheckQueueSpeed_4Threads);
+BENCHMARK(CheckQueueSpeed_8Threads);
+BENCHMARK(CheckQueueSpeed_16Threads);
+BENCHMARK(CheckQueueSpeed_32Threads);
+BENCHMARK(CheckQueueSpeed_64Threads);
@@ -0,0 +1,56 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "uint256.h"
+
+#include <vector>
+
+/* Number of bytes to hash per iteration */
+static const uint64_t BUFFER_SIZE = 1000*1000;
+
+// Bulk hashing, as done for block and transaction serializations.
+static void SHA256(benchmark::State& state)
+{
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE, 0);
+    while (state.KeepRunning())
+        CSHA256().Write(in.data(), in.size()).Finalize(hash);
+}
+
+// Short messages, where the padding block makes up half of the work.
+static void SHA256_32b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(32, 0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++)
+            CSHA256().Write(in.data(), in.size()).Finalize(in.data());
+    }
+}
+
+// Double-SHA256 of a 64-byte merkle node.
+static void DoubleSHA256_64b(benchmark::State& state)
+{
+    uint256 left, right;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++)
+            left = Hash(left.begin(), left.end(), right.begin(), right.end());
+    }
+}
+
+// One merkle tree level of 1024 nodes, hashed in a single batch.
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning())
+        SHA256D64(in.data(), in.data(), 1024);
+}
+
+BENCHMARK(SHA256);
+BENCHMARK(SHA256_32b);
+BENCHMARK(DoubleSHA256_64b);
+BENCHMARK(SHA256D64_1024);
@@ -0,0 +1,107 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "arith_uint256.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+
+#include <list>
+#include <vector>
+
+// Number of independent chains and the number of transactions in each.
+// Chains this deep are well above the default ancestor limit; they are added
+// with addUnchecked, so acceptance limits don't apply.
+static const int CHAIN_COUNT = 4;
+static const int CHAIN_LENGTH = 100;
+
+static void AddTx(const CTransaction& tx, const CAmount& nFee, CTxMemPool& pool)
+{
+    int64_t nTime = 0;
+    double dPriority = 10.0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int nSigOps = 1;
+    LockPoints lp;
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(
+                                        tx, nFee, nTime, dPriority, nHeight, pool.HasNoInputsOf(tx),
+                                        0, spendsCoinbase, nSigOps, lp));
+}
+
+// Build CHAIN_COUNT chains where every transaction spends the single output
+// of the previous one.
+static void CreateChains(std::vector<std::vector<CTransaction> >& vChains)
+{
+    vChains.resize(CHAIN_COUNT);
+    for (int i = 0; i < CHAIN_COUNT; i++) {
+        uint256 hashPrev = ArithToUint256(arith_uint256(i + 1));
+        for (int j = 0; j < CHAIN_LENGTH; j++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(hashPrev, 0);
+            tx.vin[0].scriptSig = CScript() << OP_1;
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            tx.vout[0].nValue = (CHAIN_LENGTH - j) * COIN;
+            vChains[i].push_back(tx);
+            hashPrev = tx.GetHash();
+        }
+    }
+}
+
+// Accept the chains into an empty pool, then evict them again by removing
+// the first transaction of each chain with all of its descendants.
+static void MempoolChainAcceptance(benchmark::State& state)
+{
+    std::vector<std::vector<CTransaction> > vChains;
+    CreateChains(vChains);
+
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(1000));
+        LOCK(pool.cs);
+        for (int j = 0; j < CHAIN_LENGTH; j++) {
+            for (int i = 0; i < CHAIN_COUNT; i++) {
+                AddTx(vChains[i][j], 10000, pool);
+            }
+        }
+        for (int i = 0; i < CHAIN_COUNT; i++) {
+            std::list<CTransaction> removed;
+            pool.remove(vChains[i][0], removed, true);
+        }
+    }
+}
+
+// Accept the chains into an empty pool, then confirm them a few
+// transactions at a time, which updates the ancestor state of everything
+// left in each chain.
+static void MempoolChainConfirmation(benchmark::State& state)
+{
+    std::vector<std::vector<CTransaction> > vChains;
+    CreateChains(vChains);
+
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(1000));
+        LOCK(pool.cs);
+        for (int j = 0; j < CHAIN_LENGTH; j++) {
+            for (int i = 0; i < CHAIN_COUNT; i++) {
+                AddTx(vChains[i][j], 10000, pool);
+            }
+        }
+        for (int j = 0; j < CHAIN_LENGTH; j += 10) {
+            std::vector<CTransaction> vtx;
+            for (int i = 0; i < CHAIN_COUNT; i++) {
+                for (int k = j; k < j + 10 && k < CHAIN_LENGTH; k++) {
+                    vtx.push_back(vChains[i][k]);
+                }
+            }
+            std::list<CTransaction> conflicts;
+            pool.removeForBlock(vtx, 1 + j / 10, conflicts, false);
+        }
+    }
+}
+
+BENCHMARK(MempoolChainAcceptance);
+BENCHMARK(MempoolChainConfirmation);
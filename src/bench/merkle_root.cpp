@@ -0,0 +1,26 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "consensus/merkle.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <vector>
+
+// The merkle root of a block with 9001 transactions.
+static void MerkleRoot(benchmark::State& state)
+{
+    std::vector<uint256> leaves(9001);
+    for (size_t i = 0; i < leaves.size(); i++)
+        leaves[i] = GetRandHash();
+    while (state.KeepRunning()) {
+        bool mutated = false;
+        uint256 hash = ComputeMerkleRoot(leaves, &mutated);
+        leaves[mutated] = hash;
+    }
+}
+
+BENCHMARK(MerkleRoot);
@@ -0,0 +1,78 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "hash.h"
+#include "key.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "script/sigcache.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+// Number of distinct signatures held in the cache, and the number of lookups
+// every thread performs per benchmark iteration.
+static const int SIGNATURE_COUNT = 256;
+static const int LOOKUPS_PER_THREAD = 1000;
+
+struct CachedSignature
+{
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+};
+
+static void LookupSignatures(const std::vector<CachedSignature>* pvSigs, const CPubKey* pubkey, bool fStore, int nOffset)
+{
+    CTransaction txDummy;
+    CachingTransactionSignatureChecker checker(&txDummy, 0, fStore);
+    for (int i = 0; i < LOOKUPS_PER_THREAD; i++) {
+        const CachedSignature& sig = (*pvSigs)[(nOffset + i) % pvSigs->size()];
+        checker.VerifySignature(sig.vchSig, *pubkey, sig.hash);
+    }
+}
+
+// Every thread repeatedly looks up signatures which are already in the cache,
+// the way the script check threads do when a block's transactions have
+// already been accepted to the mempool. With fStore unset a hit also marks
+// the entry for eviction, which is what ConnectBlock does.
+static void SigCacheContention(benchmark::State& state, int nThreads, bool fStore)
+{
+    ECCVerifyHandle verifyHandle;
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    std::vector<CachedSignature> vSigs(SIGNATURE_COUNT);
+    for (int i = 0; i < SIGNATURE_COUNT; i++) {
+        vSigs[i].hash = Hash(BEGIN(i), END(i));
+        key.Sign(vSigs[i].hash, vSigs[i].vchSig);
+    }
+    // Verify once with storing enabled so the lookups below are all hits
+    LookupSignatures(&vSigs, &pubkey, true, 0);
+
+    while (state.KeepRunning()) {
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&LookupSignatures, &vSigs, &pubkey, fStore, i * SIGNATURE_COUNT / nThreads));
+        threads.join_all();
+    }
+}
+
+static void SigCacheMempool_1Thread(benchmark::State& state) { SigCacheContention(state, 1, true); }
+static void SigCacheMempool_4Threads(benchmark::State& state) { SigCacheContention(state, 4, true); }
+static void SigCacheMempool_16Threads(benchmark::State& state) { SigCacheContention(state, 16, true); }
+static void SigCacheBlock_1Thread(benchmark::State& state) { SigCacheContention(state, 1, false); }
+static void SigCacheBlock_4Threads(benchmark::State& state) { SigCacheContention(state, 4, false); }
+static void SigCacheBlock_16Threads(benchmark::State& state) { SigCacheContention(state, 16, false); }
+
+BENCHMARK(SigCacheMempool_1Thread);
+BENCHMARK(SigCacheMempool_4Threads);
+BENCHMARK(SigCacheMempool_16Threads);
+BENCHMARK(SigCacheBlock_1Thread);
+BENCHMARK(SigCacheBlock_4Threads);
+BENCHMARK(SigCacheBlock_16Threads);
@@ -0,0 +1,97 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "policy/policy.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+#include "script/standard.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Heap allocations made through operator new while fCountAllocations is
+// set, so the verification benchmarks can report how many they need per
+// input. Counting is off otherwise, leaving the other benchmarks in this
+// binary with a single relaxed load per allocation. Prevectors that outgrow
+// their inline space allocate with malloc and are not counted; the P2PKH
+// spend below has none of those.
+static std::atomic<bool> fCountAllocations(false);
+static std::atomic<uint64_t> nAllocations(0);
+
+void* operator new(size_t size)
+{
+    if (fCountAllocations.load(std::memory_order_relaxed))
+        nAllocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+// Verify the signature of a P2PKH input with the standard flags, the way the
+// mempool does on a signature cache miss. fGeneric skips the template
+// verifier to compare against the opcode loop.
+static void RunVerifyScriptP2PKH(benchmark::State& state, bool fGeneric)
+{
+    ECCVerifyHandle verifyHandle;
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    CMutableTransaction txCredit;
+    txCredit.vin.resize(1);
+    txCredit.vout.resize(1);
+    txCredit.vout[0].scriptPubKey = GetScriptForDestination(pubkey.GetID());
+    txCredit.vout[0].nValue = 1;
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txCredit.GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 1;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(txCredit.vout[0].scriptPubKey, txSpend, 0, SIGHASH_ALL);
+    key.Sign(hash, vchSig);
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    txSpend.vin[0].scriptSig << vchSig << ToByteVector(pubkey);
+
+    const CTransaction tx(txSpend);
+    TransactionSignatureChecker checker(&tx, 0);
+    const CScript& scriptSig = tx.vin[0].scriptSig;
+    const CScript& scriptPubKey = txCredit.vout[0].scriptPubKey;
+
+    nAllocations = 0;
+    fCountAllocations = true;
+    bool fOk = fGeneric ? VerifyScriptGeneric(scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, checker) :
+                          VerifyScript(scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, checker);
+    fCountAllocations = false;
+    assert(fOk);
+    std::cout << "# VerifyScriptP2PKH" << (fGeneric ? "_Generic" : "") << ": " << nAllocations << " heap allocations per input\n";
+
+    while (state.KeepRunning()) {
+        ScriptError err;
+        fOk = fGeneric ? VerifyScriptGeneric(scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, checker, &err) :
+                         VerifyScript(scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, checker, &err);
+        assert(fOk);
+    }
+}
+
+static void VerifyScriptP2PKH(benchmark::State& state) { RunVerifyScriptP2PKH(state, false); }
+static void VerifyScriptP2PKH_Generic(benchmark::State& state) { RunVerifyScriptP2PKH(state, true); }
+
+BENCHMARK(VerifyScriptP2PKH);
+BENCHMARK(VerifyScriptP2PKH_Generic);
@@ -0,0 +1,286 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <limits>
+#include <stdexcept>
+
+#include <boost/foreach.hpp>
+
+/** Writes a stream of bits, most significant bit first, to the end of a byte vector */
+class CBitStreamWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+    uint8_t nBuffer;
+    int nOffset;  //!< Number of bits of nBuffer already used
+
+public:
+    explicit CBitStreamWriter(std::vector<unsigned char>& vchIn) : vch(vchIn), nBuffer(0), nOffset(0) {}
+    ~CBitStreamWriter() { Flush(); }
+
+    /** Write the nBits (at most 64) least significant bits of data */
+    void Write(uint64_t data, int nBits)
+    {
+        while (nBits > 0) {
+            int nWrite = std::min(8 - nOffset, nBits);
+            nBuffer |= (data << (64 - nBits)) >> (64 - 8 + nOffset);
+            nOffset += nWrite;
+            nBits -= nWrite;
+            if (nOffset == 8)
+                Flush();
+        }
+    }
+
+    /** Write out the last partial byte, padded with zero bits */
+    void Flush()
+    {
+        if (nOffset == 0)
+            return;
+        vch.push_back(nBuffer);
+        nBuffer = 0;
+        nOffset = 0;
+    }
+};
+
+/** Reads a stream of bits written by CBitStreamWriter */
+class CBitStreamReader
+{
+private:
+    const std::vector<unsigned char>& vch;
+    size_t nPos;
+    uint8_t nBuffer;
+    int nOffset;  //!< Number of bits of nBuffer already read
+
+public:
+    CBitStreamReader(const std::vector<unsigned char>& vchIn, size_t nPosIn) : vch(vchIn), nPos(nPosIn), nBuffer(0), nOffset(8) {}
+
+    /** Read nBits (at most 64) bits into the least significant bits of the result */
+    uint64_t Read(int nBits)
+    {
+        uint64_t data = 0;
+        while (nBits > 0) {
+            if (nOffset == 8) {
+                if (nPos >= vch.size())
+                    throw std::ios_base::failure("CBitStreamReader::Read(): end of data");
+                nBuffer = vch[nPos++];
+                nOffset = 0;
+            }
+            int nRead = std::min(8 - nOffset, nBits);
+            data <<= nRead;
+            data |= static_cast<uint8_t>(nBuffer << nOffset) >> (8 - nRead);
+            nOffset += nRead;
+            nBits -= nRead;
+        }
+        return data;
+    }
+};
+
+static void GolombRiceEncode(CBitStreamWriter& bitwriter, int nP, uint64_t x)
+{
+    // The quotient is written in unary, as that many 1 bits followed by a 0
+    uint64_t q = x >> nP;
+    while (q > 0) {
+        int nBits = q <= 64 ? (int)q : 64;
+        bitwriter.Write(~0ULL, nBits);
+        q -= nBits;
+    }
+    bitwriter.Write(0, 1);
+
+    // The remainder in its nP least significant bits
+    bitwriter.Write(x, nP);
+}
+
+static uint64_t GolombRiceDecode(CBitStreamReader& bitreader, int nP)
+{
+    uint64_t q = 0;
+    while (bitreader.Read(1) == 1)
+        q++;
+    uint64_t r = bitreader.Read(nP);
+    return (q << nP) + r;
+}
+
+/** Map x uniformly into [0, n), as the high 64 bits of the 128-bit product x * n */
+static uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * (unsigned __int128)n) >> 64);
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t ac = x_hi * n_hi;
+    uint64_t ad = x_hi * n_lo;
+    uint64_t bc = x_lo * n_hi;
+    uint64_t bd = x_lo * n_lo;
+    uint64_t mid = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid >> 32);
+#endif
+}
+
+uint64_t GCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t hash = CSipHasher(params.nSipHashK0, params.nSipHashK1)
+        .Write(element.empty() ? NULL : &element[0], element.size())
+        .Finalize();
+    return MapIntoRange(hash, nF);
+}
+
+GCSFilter::GCSFilter(const Params& paramsIn) :
+    params(paramsIn), nN(0), nF(0)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(stream, nN);
+    vchEncoded.assign(stream.begin(), stream.end());
+}
+
+GCSFilter::GCSFilter(const Params& paramsIn, const std::vector<unsigned char>& vchEncodedIn) :
+    params(paramsIn), vchEncoded(vchEncodedIn)
+{
+    CDataStream stream(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t nElements = ReadCompactSize(stream);
+    if (nElements > std::numeric_limits<uint32_t>::max())
+        throw std::ios_base::failure("GCSFilter: N must be < 2^32");
+    nN = (uint32_t)nElements;
+    nF = (uint64_t)nN * params.nM;
+
+    // Decode all the elements, so that a truncated filter is rejected here
+    // rather than failing while being matched
+    CBitStreamReader bitreader(vchEncoded, vchEncoded.size() - stream.size());
+    for (uint32_t i = 0; i < nN; i++)
+        GolombRiceDecode(bitreader, params.nP);
+}
+
+GCSFilter::GCSFilter(const Params& paramsIn, const ElementSet& elements) :
+    params(paramsIn)
+{
+    if (elements.size() > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("GCSFilter: N must be < 2^32");
+    nN = (uint32_t)elements.size();
+    nF = (uint64_t)nN * params.nM;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(stream, nN);
+    vchEncoded.assign(stream.begin(), stream.end());
+
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(elements.size());
+    BOOST_FOREACH(const Element& element, elements)
+        vHashes.push_back(HashToRange(element));
+    std::sort(vHashes.begin(), vHashes.end());
+
+    CBitStreamWriter bitwriter(vchEncoded);
+    uint64_t nLast = 0;
+    BOOST_FOREACH(uint64_t hash, vHashes) {
+        GolombRiceEncode(bitwriter, params.nP, hash - nLast);
+        nLast = hash;
+    }
+    bitwriter.Flush();
+}
+
+bool GCSFilter::MatchInternal(const std::vector<uint64_t>& vQuery) const
+{
+    CDataStream stream(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t nElements = ReadCompactSize(stream);
+    assert(nElements == nN);
+    CBitStreamReader bitreader(vchEncoded, vchEncoded.size() - stream.size());
+
+    // Walk the sorted query and the sorted set together
+    uint64_t nValue = 0;
+    std::vector<uint64_t>::const_iterator it = vQuery.begin();
+    for (uint32_t i = 0; i < nN && it != vQuery.end(); i++) {
+        nValue += GolombRiceDecode(bitreader, params.nP);
+        while (it != vQuery.end() && *it < nValue)
+            it++;
+        if (it != vQuery.end() && *it == nValue)
+            return true;
+    }
+    return false;
+}
+
+bool GCSFilter::Match(const Element& element) const
+{
+    if (nN == 0)
+        return false;
+    return MatchInternal(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool GCSFilter::MatchAny(const ElementSet& elements) const
+{
+    if (nN == 0)
+        return false;
+    std::vector<uint64_t> vQuery;
+    vQuery.reserve(elements.size());
+    BOOST_FOREACH(const Element& element, elements)
+        vQuery.push_back(HashToRange(element));
+    std::sort(vQuery.begin(), vQuery.end());
+    return MatchInternal(vQuery);
+}
+
+/** The scripts a basic filter holds, see CBlockFilter */
+static GCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockundo)
+{
+    GCSFilter::ElementSet elements;
+
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        BOOST_FOREACH(const CTxOut& txout, tx.vout) {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            elements.insert(GCSFilter::Element(script.begin(), script.end()));
+        }
+    }
+
+    BOOST_FOREACH(const CTxUndo& txundo, blockundo.vtxundo) {
+        BOOST_FOREACH(const CTxInUndo& txinundo, txundo.vprevout) {
+            const CScript& script = txinundo.txout.scriptPubKey;
+            if (script.empty())
+                continue;
+            elements.insert(GCSFilter::Element(script.begin(), script.end()));
+        }
+    }
+
+    return elements;
+}
+
+GCSFilter::Params CBlockFilter::GetParams(uint8_t nFilterType, const uint256& hashBlock)
+{
+    assert(nFilterType == BLOCK_FILTER_BASIC);
+    // The filter is keyed by the block hash so that collisions cannot be
+    // precomputed across blocks
+    return GCSFilter::Params(ReadLE64(hashBlock.begin()), ReadLE64(hashBlock.begin() + 8),
+                             BASIC_FILTER_P, BASIC_FILTER_M);
+}
+
+CBlockFilter::CBlockFilter(uint8_t nFilterTypeIn, const uint256& hashBlockIn, const std::vector<unsigned char>& vchFilter) :
+    nFilterType(nFilterTypeIn), hashBlock(hashBlockIn), filter(GetParams(nFilterTypeIn, hashBlockIn), vchFilter)
+{
+}
+
+CBlockFilter::CBlockFilter(uint8_t nFilterTypeIn, const CBlock& block, const CBlockUndo& blockundo) :
+    nFilterType(nFilterTypeIn), hashBlock(block.GetHash()),
+    filter(GetParams(nFilterTypeIn, hashBlock), BasicFilterElements(block, blockundo))
+{
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& vchFilter = filter.GetEncoded();
+    return Hash(vchFilter.begin(), vchFilter.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256& hashPrevHeader) const
+{
+    uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), hashPrevHeader.begin(), hashPrevHeader.end());
+}
@@ -0,0 +1,152 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CREDITS_BLOCKFILTER_H
+#define CREDITS_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * A Golomb-Rice coded set (GCS) as described by BIP158: every element is
+ * hashed with SipHash into [0, N * M), the hashes are sorted and the
+ * differences between them written with Golomb-Rice parameter P. Membership
+ * tests have a false positive rate of about 1 / M.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params
+    {
+        uint64_t nSipHashK0;
+        uint64_t nSipHashK1;
+        int nP;       //!< Golomb-Rice coding parameter
+        uint32_t nM;  //!< Inverse false positive rate
+
+        Params(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0, int nPIn = 0, uint32_t nMIn = 1) :
+            nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn) {}
+    };
+
+private:
+    Params params;
+    uint32_t nN;  //!< Number of elements in the filter
+    uint64_t nF;  //!< Range of element hashes, N * M
+    std::vector<unsigned char> vchEncoded;
+
+    /** Hash an element into [0, N * M) */
+    uint64_t HashToRange(const Element& element) const;
+
+    /** Check the filter against the sorted hashes of a query, true if any is in the set */
+    bool MatchInternal(const std::vector<uint64_t>& vQuery) const;
+
+public:
+    /** Construct an empty filter */
+    explicit GCSFilter(const Params& paramsIn = Params());
+
+    /** Reconstruct a filter from its encoding. Throws std::ios_base::failure if it is malformed. */
+    GCSFilter(const Params& paramsIn, const std::vector<unsigned char>& vchEncodedIn);
+
+    /** Build a filter holding the given elements */
+    GCSFilter(const Params& paramsIn, const ElementSet& elements);
+
+    uint32_t GetN() const { return nN; }
+    const Params& GetParams() const { return params; }
+    const std::vector<unsigned char>& GetEncoded() const { return vchEncoded; }
+
+    /** Check whether element is in the set, with false positives at rate 1 / M */
+    bool Match(const Element& element) const;
+
+    /** Check whether any of the elements is in the set, decoding the filter only once */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+enum BlockFilterType
+{
+    BLOCK_FILTER_BASIC = 0,
+};
+
+/** Parameters of the basic block filter, from BIP158 */
+static const int BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+/**
+ * The filter of a block's scripts served to light clients in place of BIP37
+ * merkle blocks. The basic filter holds every output script of the block,
+ * except OP_RETURN outputs, and every script the block's inputs spend.
+ */
+class CBlockFilter
+{
+private:
+    uint8_t nFilterType;
+    uint256 hashBlock;
+    GCSFilter filter;
+
+    static GCSFilter::Params GetParams(uint8_t nFilterType, const uint256& hashBlock);
+
+public:
+    CBlockFilter() : nFilterType(BLOCK_FILTER_BASIC) {}
+
+    /** Reconstruct a filter of the given block from its encoding */
+    CBlockFilter(uint8_t nFilterTypeIn, const uint256& hashBlockIn, const std::vector<unsigned char>& vchFilter);
+
+    /** Compute the filter of a block, with the undo data for the outputs it spends */
+    CBlockFilter(uint8_t nFilterTypeIn, const CBlock& block, const CBlockUndo& blockundo);
+
+    uint8_t GetFilterType() const { return nFilterType; }
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const GCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    /** Hash of the encoded filter */
+    uint256 GetHash() const;
+
+    /** Header committing to this filter and, through hashPrevHeader, to the filters of all previous blocks */
+    uint256 ComputeHeader(const uint256& hashPrevHeader) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        std::vector<unsigned char> vchFilter;
+        if (!ser_action.ForRead())
+            vchFilter = filter.GetEncoded();
+        READWRITE(nFilterType);
+        READWRITE(hashBlock);
+        READWRITE(vchFilter);
+        if (ser_action.ForRead()) {
+            if (nFilterType != BLOCK_FILTER_BASIC)
+                throw std::ios_base::failure("unknown block filter type");
+            filter = GCSFilter(GetParams(nFilterType, hashBlock), vchFilter);
+        }
+    }
+};
+
+/** What the block filter index stores for each block */
+struct CBlockFilterIndexEntry
+{
+    uint256 hashFilter;
+    uint256 hashHeader;
+    std::vector<unsigned char> vchFilter;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashFilter);
+        READWRITE(hashHeader);
+        READWRITE(vchFilter);
+    }
+};
+
+#endif // CREDITS_BLOCKFILTER_H
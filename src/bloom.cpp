@@ -53,6 +53,14 @@ CBloomFilter::CBloomFilter(unsigned int nElements, double nFPRate, unsigned int
 {
 }
 
+/** Serialize an outpoint the way CBloomFilter::insert(const COutPoint&) does */
+static std::vector<unsigned char> SerializeOutPoint(const COutPoint& outpoint)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << outpoint;
+    return std::vector<unsigned char>(stream.begin(), stream.end());
+}
+
 inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const
 {
     // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
@@ -74,10 +82,7 @@ void CBloomFilter::insert(const std::vector<unsigned char>& vKey)
 
 void CBloomFilter::insert(const COutPoint& outpoint)
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    insert(data);
+    insert(SerializeOutPoint(outpoint));
 }
 
 void CBloomFilter::insert(const uint256& hash)
@@ -104,10 +109,7 @@ bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
 
 bool CBloomFilter::contains(const COutPoint& outpoint) const
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    return contains(data);
+    return contains(SerializeOutPoint(outpoint));
 }
 
 bool CBloomFilter::contains(const uint256& hash) const
@@ -134,7 +136,58 @@ bool CBloomFilter::IsWithinSizeConstraints() const
     return vData.size() <= MAX_BLOOM_FILTER_SIZE && nHashFuncs <= MAX_HASH_FUNCS;
 }
 
+/** The non-empty data pushes of script, up to the first opcode that fails to parse */
+static void GetScriptPushes(const CScript& script, std::vector<std::vector<unsigned char> >& vPushes)
+{
+    CScript::const_iterator pc = script.begin();
+    std::vector<unsigned char> data;
+    while (pc < script.end())
+    {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data))
+            break;
+        if (data.size() != 0)
+            vPushes.push_back(data);
+    }
+}
+
+CBloomFilterTxElements::CBloomFilterTxElements(const CTransaction& tx) :
+    hash(tx.GetHash()),
+    vOutputPushes(tx.vout.size()),
+    vOutputIsP2PubKey(tx.vout.size(), false),
+    vInputPushes(tx.vin.size())
+{
+    vOutpoints.reserve(tx.vout.size());
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        const CTxOut& txout = tx.vout[i];
+        GetScriptPushes(txout.scriptPubKey, vOutputPushes[i]);
+        vOutpoints.push_back(SerializeOutPoint(COutPoint(hash, i)));
+
+        txnouttype type;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        if (!vOutputPushes[i].empty() && Solver(txout.scriptPubKey, type, vSolutions))
+            vOutputIsP2PubKey[i] = (type == TX_PUBKEY || type == TX_MULTISIG);
+    }
+
+    vPrevouts.reserve(tx.vin.size());
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        vPrevouts.push_back(SerializeOutPoint(tx.vin[i].prevout));
+        GetScriptPushes(tx.vin[i].scriptSig, vInputPushes[i]);
+    }
+}
+
 bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
+{
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    return IsRelevantAndUpdate(CBloomFilterTxElements(tx));
+}
+
+bool CBloomFilter::IsRelevantAndUpdate(const CBloomFilterTxElements& tx)
 {
     bool fFound = false;
     // Match if the filter contains the hash of tx
@@ -143,37 +196,24 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
         return true;
     if (isEmpty)
         return false;
-    const uint256& hash = tx.GetHash();
-    if (contains(hash))
+    if (contains(tx.hash))
         fFound = true;
 
-    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    for (unsigned int i = 0; i < tx.vOutputPushes.size(); i++)
     {
-        const CTxOut& txout = tx.vout[i];
         // Match if the filter contains any arbitrary script data element in any scriptPubKey in tx
         // If this matches, also add the specific output that was matched.
         // This means clients don't have to update the filter themselves when a new relevant tx 
         // is discovered in order to find spending transactions, which avoids round-tripping and race conditions.
-        CScript::const_iterator pc = txout.scriptPubKey.begin();
-        std::vector<unsigned char> data;
-        while (pc < txout.scriptPubKey.end())
+        BOOST_FOREACH(const std::vector<unsigned char>& data, tx.vOutputPushes[i])
         {
-            opcodetype opcode;
-            if (!txout.scriptPubKey.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
+            if (contains(data))
             {
                 fFound = true;
                 if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
-                    insert(COutPoint(hash, i));
-                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY)
-                {
-                    txnouttype type;
-                    std::vector<std::vector<unsigned char> > vSolutions;
-                    if (Solver(txout.scriptPubKey, type, vSolutions) &&
-                            (type == TX_PUBKEY || type == TX_MULTISIG))
-                        insert(COutPoint(hash, i));
-                }
+                    insert(tx.vOutpoints[i]);
+                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY && tx.vOutputIsP2PubKey[i])
+                    insert(tx.vOutpoints[i]);
                 break;
             }
         }
@@ -182,21 +222,16 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     if (fFound)
         return true;
 
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    for (unsigned int i = 0; i < tx.vPrevouts.size(); i++)
     {
         // Match if the filter contains an outpoint tx spends
-        if (contains(txin.prevout))
+        if (contains(tx.vPrevouts[i]))
             return true;
 
         // Match if the filter contains any arbitrary script data element in any scriptSig in tx
-        CScript::const_iterator pc = txin.scriptSig.begin();
-        std::vector<unsigned char> data;
-        while (pc < txin.scriptSig.end())
+        BOOST_FOREACH(const std::vector<unsigned char>& data, tx.vInputPushes[i])
         {
-            opcodetype opcode;
-            if (!txin.scriptSig.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
+            if (contains(data))
                 return true;
         }
     }
@@ -9,12 +9,12 @@
 #define CREDITS_BLOOM_H
 
 #include "serialize.h"
+#include "uint256.h"
 
 #include <vector>
 
 class COutPoint;
 class CTransaction;
-class uint256;
 
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
@@ -33,6 +33,29 @@ enum bloomflags
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * The data elements of a transaction that bloom filters are matched against,
+ * taken apart once so the transaction can be matched against the filters of
+ * any number of peers without parsing its scripts again for each.
+ */
+class CBloomFilterTxElements
+{
+public:
+    uint256 hash;
+    //! Data pushes of each output's script, up to the first invalid opcode
+    std::vector<std::vector<std::vector<unsigned char> > > vOutputPushes;
+    //! Whether each output pays to a pubkey or is a bare multisig
+    std::vector<bool> vOutputIsP2PubKey;
+    //! Serialized outpoints of the outputs
+    std::vector<std::vector<unsigned char> > vOutpoints;
+    //! Serialized outpoints the inputs spend
+    std::vector<std::vector<unsigned char> > vPrevouts;
+    //! Data pushes of each input's script, up to the first invalid opcode
+    std::vector<std::vector<std::vector<unsigned char> > > vInputPushes;
+
+    explicit CBloomFilterTxElements(const CTransaction& tx);
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide
  * so that we can filter the transactions we send them.
@@ -100,6 +123,8 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
+    //! Same as above, with the elements of the transaction already extracted
+    bool IsRelevantAndUpdate(const CBloomFilterTxElements& tx);
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
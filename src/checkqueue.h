@@ -9,6 +9,10 @@
 #define CREDITS_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -19,7 +23,7 @@
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
@@ -28,12 +32,30 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker, and the master, owns a deque of pending verifications.
+  * The master spreads new verifications over the workers' deques; a worker
+  * takes batches from the back of its own deque, and when that is empty
+  * steals from the front of the others'. Each deque has its own lock, so
+  * workers only contend when they touch the same deque. The shared mutex is
+  * only used to put idle threads to sleep and to wake them again.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! A deque of verifications owned by one thread.
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        std::deque<T> queue;
+        //! Mirrors queue.size(), so empty deques can be skipped without locking.
+        std::atomic<unsigned int> nSize;
+
+        WorkerQueue() : nSize(0) {}
+    };
+
+    //! Mutex used to sleep and wake up threads, and to protect the statistics
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -42,121 +64,186 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Deques of the master (slot 0) and the workers (slots 1..nMaxWorkers)
+    std::unique_ptr<WorkerQueue[]> queues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker slots. Workers beyond this share a slot.
+    const unsigned int nMaxWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of worker threads that have started (excluding the master).
+    std::atomic<unsigned int> nWorkers;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Number of verifications that are still in one of the deques.
+    std::atomic<unsigned int> nQueued;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The slot the next Add starts distributing at.
+    unsigned int nNextSlot;
+
+    //! The largest number of outstanding verifications seen so far.
+    unsigned int nMaxTodo;
+
+    //! The total number of verifications ever added.
+    uint64_t nTotalAdded;
+
+    //! The number of slots in use: the master's plus one per started worker.
+    unsigned int SlotsInUse() const
+    {
+        return 1 + std::min((unsigned int)nWorkers, nMaxWorkers);
+    }
+
+    /**
+     * Move a batch of verifications out of the deque in slot nSlot into
+     * vChecks. The owner takes from the back and thieves from the front, so
+     * they rarely want the same elements. Take about half of what is there,
+     * so the remainder can still be shared with other threads.
+     */
+    bool TakeBatch(unsigned int nSlot, bool fSteal, std::vector<T>& vChecks)
+    {
+        WorkerQueue& wq = queues[nSlot];
+        if (wq.nSize == 0)
+            return false;
+
+        boost::unique_lock<boost::mutex> lock(wq.mutex);
+        unsigned int nAvailable = wq.queue.size();
+        if (nAvailable == 0)
+            return false;
+        unsigned int nNow = std::max(1U, std::min(nBatchSize, nAvailable / 2));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap jobs into the local batch vector instead of copying.
+            if (fSteal) {
+                vChecks[i].swap(wq.queue.front());
+                wq.queue.pop_front();
+            } else {
+                vChecks[i].swap(wq.queue.back());
+                wq.queue.pop_back();
+            }
+        }
+        wq.nSize -= nNow;
+        nQueued -= nNow;
+        return true;
+    }
+
+    //! Take a batch from our own deque, or steal one from another thread's.
+    bool FindWork(unsigned int nSlot, std::vector<T>& vChecks)
+    {
+        if (TakeBatch(nSlot, false, vChecks))
+            return true;
+        unsigned int nSlots = SlotsInUse();
+        for (unsigned int i = 1; i < nSlots; i++) {
+            if (TakeBatch((nSlot + i) % nSlots, true, vChecks))
+                return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nSlot, bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
+            if (!FindWork(nSlot, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
+                if (fMaster) {
+                    if (nTodo == 0) {
                         bool fRet = fAllOk;
                         // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
+                        fAllOk = true;
                         // return the current status
                         return fRet;
                     }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                    // Only the master adds work, so once nothing is queued
+                    // it just waits for the workers to finish their batches.
+                    if (nQueued == 0)
+                        condMaster.wait(lock);
+                } else if (nQueued == 0) {
+                    condWorker.wait(lock); // wait
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
             BOOST_FOREACH (T& check, vChecks)
                 if (fOk)
                     fOk = check();
+            unsigned int nNow = vChecks.size();
             vChecks.clear();
+            if (!fOk)
+                fAllOk = false;
+            if ((nTodo -= nNow) == 0 && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxWorkersIn) : queues(new WorkerQueue[std::max(1U, nMaxWorkersIn) + 1]), nMaxWorkers(std::max(1U, nMaxWorkersIn)), nWorkers(0), fAllOk(true), nTodo(0), nQueued(0), nBatchSize(nBatchSizeIn), nNextSlot(0), nMaxTodo(0), nTotalAdded(0) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        unsigned int nWorker = nWorkers++;
+        Loop(1 + nWorker % nMaxWorkers);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+
+        // Spread the checks over the workers' deques in contiguous chunks,
+        // starting where the previous batch stopped. Without workers they all
+        // go to the master's own deque.
+        unsigned int nSlots = SlotsInUse();
+        unsigned int nTargets = nSlots > 1 ? nSlots - 1 : 1;
+        unsigned int nChunk = (vChecks.size() + nTargets - 1) / nTargets;
         nTodo += vChecks.size();
+        nQueued += vChecks.size();
+        for (unsigned int nDone = 0; nDone < vChecks.size(); nDone += nChunk) {
+            unsigned int nSlot = nSlots > 1 ? 1 + nNextSlot++ % nTargets : 0;
+            unsigned int nEnd = std::min<unsigned int>(vChecks.size(), nDone + nChunk);
+            WorkerQueue& wq = queues[nSlot];
+            boost::unique_lock<boost::mutex> lock(wq.mutex);
+            for (unsigned int i = nDone; i < nEnd; i++) {
+                wq.queue.push_back(T());
+                vChecks[i].swap(wq.queue.back());
+            }
+            wq.nSize += nEnd - nDone;
+        }
+
+        // Idle threads check nQueued under the mutex before they sleep, so
+        // notifying under it cannot be missed.
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nMaxTodo = std::max(nMaxTodo, (unsigned int)nTodo);
+        nTotalAdded += vChecks.size();
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -167,12 +254,22 @@ public:
     bool IsIdle()
     {
         boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nTodo == 0 && nQueued == 0 && fAllOk == true);
+    }
+
+    //! Report the number of outstanding verifications, the largest that number
+    //! has been, and the total number of verifications added.
+    void GetStats(unsigned int& nTodoOut, unsigned int& nMaxTodoOut, uint64_t& nTotalAddedOut)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nTodoOut = nTodo;
+        nMaxTodoOut = nMaxTodo;
+        nTotalAddedOut = nTotalAdded;
     }
 
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
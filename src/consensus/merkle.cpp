@@ -1,5 +1,6 @@
 #include "merkle.h"
 
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "utilstrencodings.h"
 
@@ -127,10 +128,37 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
     if (proot) *proot = h;
 }
 
+/* Compute the root a whole tree level at a time, replacing the hashes in
+   place by their parents so every level is one SHA256D64 call. This gives
+   the same result as MerkleComputation, including its mutation check, which
+   never compares a node with one derived from a duplicated odd node. */
+static uint256 MerkleRootByLevel(std::vector<uint256>& hashes, bool* pmutated) {
+    bool mutated = false;
+    // Whether the last hash of the level is derived from a duplicated one.
+    bool padded = false;
+    if (hashes.empty()) {
+        hashes.push_back(uint256());
+    }
+    while (hashes.size() > 1) {
+        for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2) {
+            if (hashes[pos] == hashes[pos + 1] && !(padded && pos + 2 == hashes.size())) {
+                mutated = true;
+            }
+        }
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+            padded = true;
+        }
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+    }
+    if (pmutated) *pmutated = mutated;
+    return hashes[0];
+}
+
 uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated) {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, NULL);
-    return hash;
+    std::vector<uint256> hashes(leaves);
+    return MerkleRootByLevel(hashes, mutated);
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position) {
@@ -159,7 +187,7 @@ uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
     for (size_t s = 0; s < block.vtx.size(); s++) {
         leaves[s] = block.vtx[s].GetHash();
     }
-    return ComputeMerkleRoot(leaves, mutated);
+    return MerkleRootByLevel(leaves, mutated);
 }
 
 std::vector<uint256> BlockMerkleBranch(const CBlock& block, uint32_t position)
@@ -7,6 +7,34 @@
 #include "crypto/common.h"
 
 #include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#ifdef ENABLE_SHANI
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+
+#ifdef ENABLE_SSE41
+namespace sha256_sse41
+{
+void Transform_4way(uint32_t* const* s, const unsigned char* const* chunk);
+void TransformD64_4way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#ifdef ENABLE_AVX2
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* const* s, const unsigned char* const* chunk);
+void TransformD64_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
 
 // Internal implementation code.
 namespace
@@ -128,8 +156,278 @@ void Transform(uint32_t* s, const unsigned char* chunk)
 }
 
 } // namespace sha256
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+
+/** Process a number of consecutive 64-byte chunks with the portable implementation. */
+void TransformGeneric(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        sha256::Transform(s, chunk);
+        chunk += 64;
+    }
+}
+
+/** The transform used by CSHA256, selected by SHA256AutoDetect. */
+TransformType Transform = TransformGeneric;
+
+/** Transform one chunk for each of several independent states, s[i] with chunk[i]. */
+typedef void (*TransformMultiType)(uint32_t* const*, const unsigned char* const*);
+/** Double-SHA256 of several consecutive 64-byte inputs. */
+typedef void (*TransformD64MultiType)(unsigned char*, const unsigned char*);
+
+/** The multi-lane transforms selected by SHA256AutoDetect, and the number of
+ *  messages they process at once (0 if none are in use). */
+TransformMultiType TransformMulti = NULL;
+TransformD64MultiType TransformD64Multi = NULL;
+size_t nLanes = 0;
+
+/** Double-SHA256 of a single 64-byte input. */
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    unsigned char buf[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(in, 64).Finalize(buf);
+    CSHA256().Write(buf, sizeof(buf)).Finalize(out);
+}
+
+/** Check that a transform agrees with the portable one for 0 to 8 chunks at a time. */
+bool SelfTest(TransformType transform)
+{
+    unsigned char data[64 * 8];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = (unsigned char)(i * 37 + 11);
+    for (size_t blocks = 0; blocks <= 8; blocks++) {
+        uint32_t s1[8], s2[8];
+        sha256::Initialize(s1);
+        sha256::Initialize(s2);
+        TransformGeneric(s1, data, blocks);
+        transform(s2, data, blocks);
+        if (memcmp(s1, s2, sizeof(s1)) != 0)
+            return false;
+    }
+    return true;
+}
+
+/** Check multi-lane transforms against the single-message ones. */
+bool SelfTestMulti(TransformMultiType transform, TransformD64MultiType transformD64, size_t lanes)
+{
+    unsigned char data[64 * 8];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = (unsigned char)(i * 37 + 11);
+
+    // Give every lane a different state and chunk.
+    uint32_t s[8][8], sExpected[8][8];
+    uint32_t* ps[8];
+    const unsigned char* chunk[8];
+    for (size_t l = 0; l < lanes; l++) {
+        sha256::Initialize(s[l]);
+        TransformGeneric(s[l], data + 64 * l, 1);
+        memcpy(sExpected[l], s[l], sizeof(s[l]));
+        TransformGeneric(sExpected[l], data + 64 * (lanes - 1 - l), 1);
+        ps[l] = s[l];
+        chunk[l] = data + 64 * (lanes - 1 - l);
+    }
+    transform(ps, chunk);
+    for (size_t l = 0; l < lanes; l++) {
+        if (memcmp(s[l], sExpected[l], sizeof(s[l])) != 0)
+            return false;
+    }
+
+    unsigned char out[32 * 8], expected[32 * 8];
+    transformD64(out, data);
+    for (size_t l = 0; l < lanes; l++)
+        TransformD64(expected + 32 * l, data + 64 * l);
+    return memcmp(out, expected, 32 * lanes) == 0;
+}
+
+#if defined(ENABLE_AVX2)
+/** Read the extended processor state the OS saves and restores (XCR0). */
+uint64_t XGetBV()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return ((uint64_t)d << 32) | a;
+}
+#endif
+
+/** Progress of one message on a lane of SHA256Multi. */
+struct CLane
+{
+    size_t nMessage;
+    //! The next block, how many blocks are read directly from the message,
+    //! and how many there are including the padding.
+    size_t nBlock;
+    size_t nFull;
+    size_t nBlocks;
+    uint32_t s[8];
+    //! The final partial block of the message followed by the padding.
+    unsigned char tail[128];
+
+    void Start(size_t nMessageIn, const unsigned char* input, size_t len)
+    {
+        nMessage = nMessageIn;
+        nBlock = 0;
+        nFull = len / 64;
+        size_t nRest = len % 64;
+        size_t nTail = nRest < 56 ? 64 : 128;
+        nBlocks = nFull + nTail / 64;
+        memcpy(tail, input + 64 * nFull, nRest);
+        memset(tail + nRest, 0, nTail - nRest);
+        tail[nRest] = 0x80;
+        WriteBE64(tail + nTail - 8, (uint64_t)len << 3);
+        sha256::Initialize(s);
+    }
+
+    const unsigned char* Chunk(const unsigned char* input) const
+    {
+        return nBlock < nFull ? input + 64 * nBlock : tail + 64 * (nBlock - nFull);
+    }
+
+    void Finish(unsigned char* output) const
+    {
+        for (int i = 0; i < 8; i++)
+            WriteBE32(output + 32 * nMessage + 4 * i, s[i]);
+    }
+};
+
+/**
+ * Single SHA256 of count messages. Every lane works on its own message and
+ * picks up the next one as soon as it finishes. Once there are fewer messages
+ * left than lanes, the remaining ones are finished one at a time rather than
+ * running mostly idle lanes.
+ */
+void SHA256Multi(unsigned char* output, const unsigned char* const* inputs, const size_t* lens, size_t count)
+{
+    CLane lanes[8];
+    uint32_t* ps[8];
+    const unsigned char* chunks[8];
+    size_t nNext = 0;
+    size_t nActive = 0;
+    while (nActive < nLanes && nNext < count) {
+        lanes[nActive].Start(nNext, inputs[nNext], lens[nNext]);
+        nActive++;
+        nNext++;
+    }
+    while (nActive == nLanes) {
+        for (size_t l = 0; l < nLanes; l++) {
+            ps[l] = lanes[l].s;
+            chunks[l] = lanes[l].Chunk(inputs[lanes[l].nMessage]);
+        }
+        TransformMulti(ps, chunks);
+        for (size_t l = 0; l < nActive; l++) {
+            if (++lanes[l].nBlock < lanes[l].nBlocks)
+                continue;
+            lanes[l].Finish(output);
+            if (nNext < count) {
+                lanes[l].Start(nNext, inputs[nNext], lens[nNext]);
+                nNext++;
+            } else {
+                // Move the last active lane into this slot and look at it again.
+                lanes[l] = lanes[--nActive];
+                l--;
+            }
+        }
+    }
+    for (size_t l = 0; l < nActive; l++) {
+        CLane& lane = lanes[l];
+        if (lane.nBlock < lane.nFull) {
+            Transform(lane.s, inputs[lane.nMessage] + 64 * lane.nBlock, lane.nFull - lane.nBlock);
+            lane.nBlock = lane.nFull;
+        }
+        Transform(lane.s, lane.Chunk(inputs[lane.nMessage]), lane.nBlocks - lane.nBlock);
+        lane.Finish(output);
+    }
+    for (; nNext < count; nNext++)
+        CSHA256().Write(inputs[nNext], lens[nNext]).Finalize(output + 32 * nNext);
+}
+
 } // namespace
 
+std::string SHA256AutoDetect(int nAllowed)
+{
+    std::string ret = "standard";
+    Transform = TransformGeneric;
+    TransformMulti = NULL;
+    TransformD64Multi = NULL;
+    nLanes = 0;
+#if (defined(ENABLE_SHANI) || defined(ENABLE_SSE41) || defined(ENABLE_AVX2)) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return ret;
+    __cpuid(1, eax, ebx, ecx, edx);
+    const uint32_t ecx1 = ecx;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    const uint32_t ebx7 = ebx;
+#ifdef ENABLE_SHANI
+    // SHA-NI needs SSE4.1 as well
+    if ((nAllowed & SHA256_USE_SHANI) && ((ecx1 >> 19) & 1) && ((ebx7 >> 29) & 1) && SelfTest(sha256_shani::Transform)) {
+        Transform = sha256_shani::Transform;
+        ret = "shani";
+    }
+#endif
+    // Running several messages side by side only pays off against the
+    // portable implementation; a single SHA-NI stream is faster than a lane.
+    if (Transform != TransformGeneric)
+        return ret;
+#ifdef ENABLE_AVX2
+    // AVX2 also needs the OS to save the YMM registers (OSXSAVE, AVX, XCR0).
+    if ((nAllowed & SHA256_USE_AVX2) && ((ecx1 >> 27) & 1) && ((ecx1 >> 28) & 1) && (XGetBV() & 6) == 6 && ((ebx7 >> 5) & 1) &&
+        SelfTestMulti(sha256_avx2::Transform_8way, sha256_avx2::TransformD64_8way, 8)) {
+        TransformMulti = sha256_avx2::Transform_8way;
+        TransformD64Multi = sha256_avx2::TransformD64_8way;
+        nLanes = 8;
+        return ret + ",avx2(8way)";
+    }
+#endif
+#ifdef ENABLE_SSE41
+    if ((nAllowed & SHA256_USE_SSE41) && ((ecx1 >> 19) & 1) &&
+        SelfTestMulti(sha256_sse41::Transform_4way, sha256_sse41::TransformD64_4way, 4)) {
+        TransformMulti = sha256_sse41::Transform_4way;
+        TransformD64Multi = sha256_sse41::TransformD64_4way;
+        nLanes = 4;
+        return ret + ",sse41(4way)";
+    }
+#endif
+#endif
+    return ret;
+}
+
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks)
+{
+    if (nLanes) {
+        while (blocks >= nLanes) {
+            TransformD64Multi(output, input);
+            output += 32 * nLanes;
+            input += 64 * nLanes;
+            blocks -= nLanes;
+        }
+    }
+    while (blocks--) {
+        TransformD64(output, input);
+        output += 32;
+        input += 64;
+    }
+}
+
+void SHA256DMulti(unsigned char* output, const unsigned char* const* inputs, const size_t* lens, size_t count)
+{
+    if (nLanes == 0 || count < nLanes) {
+        for (size_t i = 0; i < count; i++) {
+            unsigned char buf[CSHA256::OUTPUT_SIZE];
+            CSHA256().Write(inputs[i], lens[i]).Finalize(buf);
+            CSHA256().Write(buf, sizeof(buf)).Finalize(output + 32 * i);
+        }
+        return;
+    }
+    std::vector<unsigned char> vFirst(32 * count);
+    SHA256Multi(&vFirst[0], inputs, lens, count);
+    std::vector<const unsigned char*> vInputs(count);
+    std::vector<size_t> vLens(count, 32);
+    for (size_t i = 0; i < count; i++)
+        vInputs[i] = &vFirst[32 * i];
+    SHA256Multi(output, &vInputs[0], &vLens[0], count);
+}
+
 
 ////// SHA-256
 
@@ -147,14 +445,15 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
-        // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+    if (end >= data + 64) {
+        // Process full chunks directly from the source, all in one call.
+        size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        bytes += 64 * blocks;
+        data += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,35 @@ public:
     CSHA256& Reset();
 };
 
+/** Hardware SHA256 implementations SHA256AutoDetect may select, as a bitmask. */
+enum SHA256Implementation
+{
+    SHA256_STANDARD = 0,
+    SHA256_USE_SHANI = (1 << 0),
+    SHA256_USE_SSE41 = (1 << 1),
+    SHA256_USE_AVX2 = (1 << 2),
+    SHA256_USE_ALL = SHA256_USE_SHANI | SHA256_USE_SSE41 | SHA256_USE_AVX2,
+};
+
+/** Autodetect the best available SHA256 implementation among those allowed by
+ *  nAllowed and make CSHA256 use it. Hardware implementations are only
+ *  selected after passing a self-test against the portable one. Returns the
+ *  name of the implementation.
+ */
+std::string SHA256AutoDetect(int nAllowed = SHA256_USE_ALL);
+
+/** Compute the double-SHA256 of each of the blocks 64-byte inputs stored
+ *  consecutively at input, writing the 32-byte results consecutively to
+ *  output. output may be equal to input, as when hashing a merkle tree level
+ *  in place.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/** Compute the double-SHA256 of count messages, message i being lens[i]
+ *  bytes at inputs[i], writing the 32-byte results consecutively to output.
+ *  On CPUs without a fast single-message implementation the messages are
+ *  hashed side by side on the multi-lane implementations.
+ */
+void SHA256DMulti(unsigned char* output, const unsigned char* const* inputs, const size_t* lens, size_t count);
+
 #endif // CREDITS_CRYPTO_SHA256_H
@@ -33,6 +33,42 @@ void HandleError(const leveldb::Status& status) throw(dbwrapper_error)
     throw dbwrapper_error("Unknown database error");
 }
 
+void XorObfuscate(char* pDst, const char* pSrc, size_t nSize, const std::vector<unsigned char>& key)
+{
+    size_t i = 0;
+    if (key.size() == sizeof(uint64_t)) {
+        // memcpy keeps this free of alignment assumptions; compilers turn the
+        // loop into plain (and usually vectorized) word loads and stores.
+        uint64_t nKey;
+        memcpy(&nKey, &key[0], sizeof(nKey));
+        for (; i + sizeof(uint64_t) <= nSize; i += sizeof(uint64_t)) {
+            uint64_t nWord;
+            memcpy(&nWord, pSrc + i, sizeof(nWord));
+            nWord ^= nKey;
+            memcpy(pDst + i, &nWord, sizeof(nWord));
+        }
+    }
+    if (key.empty()) {
+        if (pDst != pSrc)
+            memcpy(pDst, pSrc, nSize);
+        return;
+    }
+    for (size_t j = i % key.size(); i < nSize; i++) {
+        pDst[i] = pSrc[i] ^ key[j++];
+        if (j == key.size())
+            j = 0;
+    }
+}
+
+bool IsObfuscating(const std::vector<unsigned char>& key)
+{
+    for (size_t i = 0; i < key.size(); i++) {
+        if (key[i] != 0)
+            return true;
+    }
+    return false;
+}
+
 static leveldb::Options GetOptions(size_t nCacheSize)
 {
     leveldb::Options options;
@@ -52,6 +88,7 @@ static leveldb::Options GetOptions(size_t nCacheSize)
 CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
 {
     penv = NULL;
+    fObfuscated = false;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
@@ -90,6 +127,7 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
 
         LogPrintf("Wrote new obfuscate key for %s: %s\n", path.string(), GetObfuscateKeyHex());
     }
+    fObfuscated = IsObfuscating(obfuscate_key);
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), GetObfuscateKeyHex());
 }
@@ -150,6 +188,9 @@ std::string CDBWrapper::GetObfuscateKeyHex() const
     return HexStr(obfuscate_key);
 }
 
+CDBIterator::CDBIterator(leveldb::Iterator *piterIn, const std::vector<unsigned char>* obfuscate_key) :
+    piter(piterIn), obfuscate_key(obfuscate_key), fObfuscated(IsObfuscating(*obfuscate_key)) { }
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
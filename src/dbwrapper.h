@@ -20,6 +20,9 @@
 
 #include <boost/filesystem/path.hpp>
 
+#include <algorithm>
+#include <memory>
+
 class dbwrapper_error : public std::runtime_error
 {
 public:
@@ -28,6 +31,12 @@ public:
 
 void HandleError(const leveldb::Status& status) throw(dbwrapper_error);
 
+/** XOR nSize bytes of pSrc with the repeating key into pDst, a 64-bit word at a time for 8-byte keys. pDst may equal pSrc. */
+void XorObfuscate(char* pDst, const char* pSrc, size_t nSize, const std::vector<unsigned char>& key);
+
+/** Whether XOR-ing with this key changes the data at all. */
+bool IsObfuscating(const std::vector<unsigned char>& key);
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
 {
@@ -77,6 +86,10 @@ class CDBIterator
 private:
     leveldb::Iterator *piter;
     const std::vector<unsigned char> *obfuscate_key;
+    //! false if the key is all zeroes, in which case values are read in place
+    bool fObfuscated;
+    //! reused buffer for de-obfuscated values
+    std::vector<char> vchValue;
 
 public:
 
@@ -84,8 +97,7 @@ public:
      * @param[in] piterIn          The original leveldb iterator.
      * @param[in] obfuscate_key    If passed, XOR data with this key.
      */
-    CDBIterator(leveldb::Iterator *piterIn, const std::vector<unsigned char>* obfuscate_key) :
-        piter(piterIn), obfuscate_key(obfuscate_key) { };
+    CDBIterator(leveldb::Iterator *piterIn, const std::vector<unsigned char>* obfuscate_key);
     ~CDBIterator();
 
     bool Valid();
@@ -105,7 +117,7 @@ public:
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             ssKey >> key;
         } catch (const std::exception&) {
             return false;
@@ -116,8 +128,13 @@ public:
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(*obfuscate_key);
+            const char* pbegin = slValue.data();
+            if (fObfuscated) {
+                vchValue.resize(slValue.size());
+                XorObfuscate(vchValue.data(), slValue.data(), slValue.size(), *obfuscate_key);
+                pbegin = vchValue.data();
+            }
+            CSpanReader ssValue(pbegin, pbegin + slValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -158,6 +175,9 @@ private:
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
+    //! false if obfuscate_key is all zeroes, in which case values are read in place
+    bool fObfuscated;
+
     //! the key under which the obfuscation key is stored
     static const std::string OBFUSCATE_KEY_KEY;
 
@@ -166,6 +186,13 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! Orders positions in a list of serialized keys the way leveldb stores them
+    struct SliceIndexLess {
+        const std::vector<leveldb::Slice>& slices;
+        SliceIndexLess(const std::vector<leveldb::Slice>& slicesIn) : slices(slicesIn) {}
+        bool operator()(size_t a, size_t b) const { return slices[a].compare(slices[b]) < 0; }
+    };
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -195,8 +222,9 @@ public:
             HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(obfuscate_key);
+            if (fObfuscated)
+                XorObfuscate(&strValue[0], strValue.data(), strValue.size(), obfuscate_key);
+            CSpanReader ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -204,6 +232,78 @@ public:
         return true;
     }
 
+    /**
+     * Read the values of many keys at once.
+     *
+     * The keys are serialized into one buffer and visited in database order
+     * through a single iterator, which reads from one consistent snapshot,
+     * only seeks when a key lies ahead of its current position and reuses
+     * the value buffer. Missing or undecodable entries are reported through
+     * vFound.
+     *
+     * @return the number of keys found
+     */
+    template <typename K, typename V>
+    size_t ReadMany(const std::vector<K>& keys, std::vector<V>& values, std::vector<bool>& vFound) const throw(dbwrapper_error)
+    {
+        values.assign(keys.size(), V());
+        vFound.assign(keys.size(), false);
+        if (keys.empty())
+            return 0;
+
+        CDataStream ssKeys(SER_DISK, CLIENT_VERSION);
+        std::vector<size_t> vOffset(keys.size() + 1);
+        for (size_t i = 0; i < keys.size(); i++) {
+            vOffset[i] = ssKeys.size();
+            ssKeys << keys[i];
+        }
+        vOffset[keys.size()] = ssKeys.size();
+
+        std::vector<leveldb::Slice> slKeys(keys.size());
+        std::vector<size_t> vOrder(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            slKeys[i] = leveldb::Slice(&ssKeys[0] + vOffset[i], vOffset[i + 1] - vOffset[i]);
+            vOrder[i] = i;
+        }
+        std::sort(vOrder.begin(), vOrder.end(), SliceIndexLess(slKeys));
+
+        std::unique_ptr<leveldb::Iterator> piter(pdb->NewIterator(readoptions));
+        std::vector<char> vchValue;
+        size_t nFound = 0;
+        bool fPositioned = false;
+        for (size_t n = 0; n < vOrder.size(); n++) {
+            size_t i = vOrder[n];
+            if (!fPositioned || piter->key().compare(slKeys[i]) < 0) {
+                piter->Seek(slKeys[i]);
+                fPositioned = true;
+                if (!piter->Valid())
+                    break;
+            }
+            if (piter->key().compare(slKeys[i]) != 0)
+                continue;
+            leveldb::Slice slValue = piter->value();
+            try {
+                const char* pbegin = slValue.data();
+                if (fObfuscated) {
+                    vchValue.resize(slValue.size());
+                    XorObfuscate(vchValue.data(), slValue.data(), slValue.size(), obfuscate_key);
+                    pbegin = vchValue.data();
+                }
+                CSpanReader ssValue(pbegin, pbegin + slValue.size(), SER_DISK, CLIENT_VERSION);
+                ssValue >> values[i];
+            } catch (const std::exception&) {
+                continue;
+            }
+            vFound[i] = true;
+            nFound++;
+        }
+        if (!piter->status().ok()) {
+            LogPrintf("LevelDB read failure: %s\n", piter->status().ToString());
+            HandleError(piter->status());
+        }
+        return nFound;
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false) throw(dbwrapper_error)
     {
@@ -9,6 +9,9 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 bool CHDChain::SetNull()
 {
     LOCK(cs_accounts);
@@ -147,15 +150,13 @@ uint256 CHDChain::GetSeedHash()
     return Hash(vchSeed.begin(), vchSeed.end());
 }
 
-void CHDChain::DeriveChildExtKey(uint32_t nAccountIndex, bool fInternal, uint32_t nChildIndex, CExtKey& extKeyRet)
+void CHDChain::DeriveChainExtKey(uint32_t nAccountIndex, bool fInternal, CExtKey& chainKeyRet)
 {
     // Use BIP44 keypath scheme i.e. m / purpose' / coin_type' / account' / change / address_index
     CExtKey masterKey;              //hd master key
     CExtKey purposeKey;             //key at m/purpose'
     CExtKey cointypeKey;            //key at m/purpose'/coin_type'
     CExtKey accountKey;             //key at m/purpose'/coin_type'/account'
-    CExtKey changeKey;              //key at m/purpose'/coin_type'/account'/change
-    CExtKey childKey;               //key at m/purpose'/coin_type'/account'/change/address_index
 
     masterKey.SetMaster(&vchSeed[0], vchSeed.size());
 
@@ -169,11 +170,43 @@ void CHDChain::DeriveChildExtKey(uint32_t nAccountIndex, bool fInternal, uint32_
     // derive m/purpose'/coin_type'/account'
     cointypeKey.Derive(accountKey, nAccountIndex | 0x80000000);
     // derive m/purpose'/coin_type'/account/change
-    accountKey.Derive(changeKey, fInternal ? 1 : 0);
+    accountKey.Derive(chainKeyRet, fInternal ? 1 : 0);
+}
+
+void CHDChain::DeriveChildExtKey(uint32_t nAccountIndex, bool fInternal, uint32_t nChildIndex, CExtKey& extKeyRet)
+{
+    CExtKey changeKey;              //key at m/purpose'/coin_type'/account'/change
+
+    DeriveChainExtKey(nAccountIndex, fInternal, changeKey);
     // derive m/purpose'/coin_type'/account/change/address_index
     changeKey.Derive(extKeyRet, nChildIndex);
 }
 
+//! Children each derivation thread should get at least
+static const unsigned int MIN_KEYS_PER_DERIVATION_THREAD = 64;
+
+static void DeriveChildExtPubKeysStrided(const CExtPubKey& chainPubKey, uint32_t nFirstChildIndex, std::vector<CExtPubKey>* pvExtPubKeys, unsigned int nOffset, unsigned int nStep)
+{
+    for (unsigned int i = nOffset; i < pvExtPubKeys->size(); i += nStep)
+        chainPubKey.Derive((*pvExtPubKeys)[i], nFirstChildIndex + i);
+}
+
+void CHDChain::DeriveChildExtPubKeys(uint32_t nAccountIndex, bool fInternal, uint32_t nFirstChildIndex, uint32_t nCount, std::vector<CExtPubKey>& vExtPubKeysRet, unsigned int nThreads)
+{
+    CExtKey changeKey;
+    DeriveChainExtKey(nAccountIndex, fInternal, changeKey);
+    const CExtPubKey changePubKey = changeKey.Neuter();
+
+    vExtPubKeysRet.assign(nCount, CExtPubKey());
+    nThreads = std::max(std::min(nThreads, nCount / MIN_KEYS_PER_DERIVATION_THREAD), 1U);
+
+    boost::thread_group threadGroup;
+    for (unsigned int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&DeriveChildExtPubKeysStrided, boost::cref(changePubKey), nFirstChildIndex, &vExtPubKeysRet, i, nThreads));
+    DeriveChildExtPubKeysStrided(changePubKey, nFirstChildIndex, &vExtPubKeysRet, 0, nThreads);
+    threadGroup.join_all();
+}
+
 void CHDChain::AddAccount()
 {
     LOCK(cs_accounts);
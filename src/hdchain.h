@@ -43,6 +43,8 @@ private:
     // critical section to protect mapAccounts
     mutable CCriticalSection cs_accounts;
 
+    void DeriveChainExtKey(uint32_t nAccountIndex, bool fInternal, CExtKey& chainKeyRet);
+
 public:
 
     CHDChain() : nVersion(CHDChain::CURRENT_VERSION) { SetNull(); }
@@ -112,6 +114,13 @@ public:
 
     uint256 GetSeedHash();
     void DeriveChildExtKey(uint32_t nAccountIndex, bool fInternal, uint32_t nChildIndex, CExtKey& extKeyRet);
+    /**
+     * Derive the public keys of children nFirstChildIndex ... nFirstChildIndex + nCount - 1
+     * on up to nThreads threads. Each is the public half of what DeriveChildExtKey returns,
+     * but the path down to the external or internal chain is only derived once, and the
+     * children are derived from the chain's public key.
+     */
+    void DeriveChildExtPubKeys(uint32_t nAccountIndex, bool fInternal, uint32_t nFirstChildIndex, uint32_t nCount, std::vector<CExtPubKey>& vExtPubKeysRet, unsigned int nThreads);
 
     void AddAccount();
     bool GetAccount(uint32_t nAccountIndex, CHDAccount& hdAccountRet);
@@ -59,6 +59,7 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool replyStarted;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -114,6 +115,23 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply, for bodies that are produced incrementally.
+     * Follow with any number of WriteReplyChunk calls and one WriteReplyEnd.
+     *
+     * @note call WriteHeader before this, and not WriteReply after it.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /** Send the next part of a reply started with WriteReplyStart. */
+    void WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Finish a chunked reply. Like WriteReply this gives the request back to
+     * the main thread.
+     */
+    void WriteReplyEnd();
 };
 
 /** Event handler closure.
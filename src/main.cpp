@@ -10,10 +10,12 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockfilter.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
+#include "cuckoocache.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
@@ -80,6 +82,7 @@ bool fTxIndex = true;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fBlockFilterIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -97,6 +100,10 @@ CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
 
 CTxMemPool mempool(::minRelayTxFee);
 
+/** Script checks for the -par worker threads, used by both ConnectBlock and AcceptToMemoryPool */
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
+static std::atomic<uint64_t> nMempoolScriptCheckTxs(0);
+
 struct IteratorComparator
 {
     template<typename I>
@@ -107,7 +114,7 @@ struct IteratorComparator
 };
 
 struct COrphanTx {
-    CTransaction tx;
+    CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
 };
@@ -629,9 +636,9 @@ CBlockTreeDB *pblocktree = NULL;
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    uint256 hash = tx.GetHash();
+    uint256 hash = tx->GetHash();
     if (mapOrphanTransactions.count(hash))
         return false;
 
@@ -642,7 +649,7 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
     // have been mined or received.
     // 100 orphans, each of which is at most 99,999 bytes big is
     // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
-    unsigned int sz = tx.GetSerializeSize(SER_NETWORK, CTransaction::CURRENT_VERSION);
+    unsigned int sz = tx->GetSerializeSize(SER_NETWORK, CTransaction::CURRENT_VERSION);
     if (sz >= MAX_STANDARD_TX_SIZE)
     {
         LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
@@ -651,7 +658,7 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
 
     auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME});
     assert(ret.second);
-    BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+    BOOST_FOREACH(const CTxIn& txin, tx->vin) {
         mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
     }
 
@@ -665,7 +672,7 @@ int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return 0;
-    BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
+    BOOST_FOREACH(const CTxIn& txin, it->second.tx->vin)
     {
         auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
         if (itPrev == mapOrphanTransactionsByPrev.end())
@@ -687,7 +694,7 @@ void EraseOrphansFor(NodeId peer)
         std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
         if (maybeErase->second.fromPeer == peer)
         {
-            nErased += EraseOrphanTx(maybeErase->second.tx.GetHash());
+            nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
         }
     }
     if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
@@ -708,7 +715,7 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRE
         {
             std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
             if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx.GetHash());
+                nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
             } else {
                 nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
             }
@@ -1096,8 +1103,37 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
+/**
+ * Run the script checks of a transaction entering the mempool on the script
+ * checking threads, with this thread joining in until they are done. Single
+ * input transactions, and nodes without -par, verify inline as before. If the
+ * queued checks fail the inputs are checked again inline, so state gets the
+ * same reject reason and DoS score as before; the signature cache makes this
+ * cost no more than the failing input.
+ *
+ * This spreads the script checks over more cores but does not shorten how
+ * long cs_main is held on accept: the caller holds it throughout, and the
+ * checks still run against the locked pcoinsTip view rather than a UTXO
+ * snapshot.
+ */
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags)
+{
+    if (nScriptCheckThreads && tx.vin.size() > 1) {
+        std::vector<CScriptCheck> vChecks;
+        if (!CheckInputs(tx, state, view, true, flags, true, false, &vChecks))
+            return false;
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        if (control.Wait()) {
+            nMempoolScriptCheckTxs++;
+            return true;
+        }
+    }
+    return CheckInputs(tx, state, view, true, flags, true, false);
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                              bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee,
+                              bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee,
                               std::vector<uint256>& vHashTxnToUncache, bool fDryRun)
 {
     AssertLockHeld(cs_main);
@@ -1288,7 +1324,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp);
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp);
         unsigned int nSize = entry.GetTxSize();
 
         // Check that the transaction doesn't have an excessive number of
@@ -1389,20 +1425,6 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
                 // Save these to avoid repeated lookups
                 setIterConflicting.insert(mi);
 
-                // If this entry is "dirty", then we don't have descendant
-                // state for this transaction, which means we probably have
-                // lots of in-mempool descendants.
-                // Don't allow replacements of dirty transactions, to ensure
-                // that we don't spend too much time walking descendants.
-                // This should be rare.
-                if (mi->IsDirty()) {
-                    return state.DoS(0,
-                            error("AcceptToMemoryPool: rejecting replacement %s; cannot replace tx %s with untracked descendants",
-                                hash.ToString(),
-                                mi->GetTx().GetHash().ToString()),
-                            REJECT_NONSTANDARD, "too many potential replacements");
-                }
-
                 // Don't allow the replacement to reduce the feerate of the
                 // mempool.
                 //
@@ -1506,7 +1528,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true))
+        if (!CheckInputsForMempool(tx, state, view, STANDARD_SCRIPT_VERIFY_FLAGS))
             return false;
 
         // Check again against just the consensus-critical mandatory script
@@ -1518,7 +1540,13 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+        //
+        // The check is done with the flags the next block will be verified
+        // with, which include the mandatory ones, and the result is stored in
+        // the script execution cache so that ConnectBlock can skip the
+        // transaction's scripts entirely.
+        unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip()) | MANDATORY_SCRIPT_VERIFY_FLAGS;
+        if (!CheckInputs(tx, state, view, true, currentBlockScriptVerifyFlags, true, true))
         {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
@@ -1556,16 +1584,20 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         }
     }
 
-    if(!fDryRun) SyncWithWallets(tx, NULL);
+    if(!fDryRun) {
+        SyncWithWallets(tx, NULL);
+        // Wake up getblocktemplate long polls waiting for new transactions
+        cvBlockChange.notify_all();
+    }
 
     return true;
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fDryRun)
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fDryRun)
 {
     std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee, vHashTxToUncache, fDryRun);
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, fRejectAbsurdFee, vHashTxToUncache, fDryRun);
     if (!res || fDryRun) {
         if(!res) LogPrint("mempool", "%s: %s %s\n", __func__, tx.GetHash().ToString(), state.GetRejectReason());
         BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
@@ -1574,6 +1606,12 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return res;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fDryRun)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectAbsurdFee, fDryRun);
+}
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes)
 {
     if (!fTimestampIndex)
@@ -1585,6 +1623,14 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::v
     return true;
 }
 
+bool GetBlockFilterIndex(const uint256 &hashBlock, CBlockFilterIndexEntry &entry)
+{
+    if (!fBlockFilterIndex)
+        return error("Block filter index not enabled");
+
+    return pblocktree->ReadBlockFilterIndex(hashBlock, entry);
+}
+
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 {
     if (!fSpentIndex)
@@ -1599,6 +1645,39 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     return true;
 }
 
+bool GetSpentIndex(const std::vector<CSpentIndexKey> &keys, std::vector<CSpentIndexValue> &values, std::vector<bool> &vFound)
+{
+    values.assign(keys.size(), CSpentIndexValue());
+    vFound.assign(keys.size(), false);
+    if (!fSpentIndex)
+        return false;
+
+    mempool.getSpentIndex(keys, values, vFound);
+
+    std::vector<CSpentIndexKey> vMissing;
+    std::vector<size_t> vMissingPos;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (!vFound[i]) {
+            vMissing.push_back(keys[i]);
+            vMissingPos.push_back(i);
+        }
+    }
+    if (vMissing.empty())
+        return true;
+
+    std::vector<CSpentIndexValue> vMissingValues;
+    std::vector<bool> vMissingFound;
+    pblocktree->ReadSpentIndex(vMissing, vMissingValues, vMissingFound);
+    for (size_t i = 0; i < vMissing.size(); i++) {
+        if (vMissingFound[i]) {
+            values[vMissingPos[i]] = vMissingValues[i];
+            vFound[vMissingPos[i]] = true;
+        }
+    }
+
+    return true;
+}
+
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
 {
@@ -1611,6 +1690,42 @@ bool GetAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool GetAddressIndex(const std::vector<std::pair<uint160, int> > &addresses,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                     int start, int end, unsigned int nMaxTxs)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    // a range with only one bound set has always meant the full history
+    if (start <= 0 || end <= 0)
+        start = end = 0;
+
+    if (!pblocktree->ReadAddressIndex(addresses, addressIndex, start, end, nMaxTxs))
+        return error("unable to get txids for addresses");
+
+    return true;
+}
+
+bool TrimAddressIndexPage(std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                          unsigned int nMaxTxs, int &nNextHeight)
+{
+    nNextHeight = 0;
+    unsigned int nTxs = 0;
+    for (size_t i = 0; i < addressIndex.size(); i++) {
+        if (i == 0 || addressIndex[i].first.blockHeight != addressIndex[i - 1].first.blockHeight ||
+            addressIndex[i].first.txindex != addressIndex[i - 1].first.txindex)
+            nTxs++;
+    }
+    if (nTxs <= nMaxTxs)
+        return true;
+
+    nNextHeight = addressIndex.back().first.blockHeight;
+    while (!addressIndex.empty() && addressIndex.back().first.blockHeight == nNextHeight)
+        addressIndex.pop_back();
+    return !addressIndex.empty();
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
@@ -2253,7 +2368,7 @@ void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCach
 
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, txdata.get()), &error)) {
         return false;
     }
     return true;
@@ -2312,7 +2427,50 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks)
+namespace {
+
+/**
+ * Transactions whose scripts were all found valid with a given set of flags.
+ * Entries are SHA256(nonce || txid || flags); a txid commits to the outputs
+ * it spends, and so to the scriptPubKeys they were checked against.
+ * Protected by cs_main.
+ */
+class CScriptExecutionCache
+{
+private:
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+
+public:
+    CScriptExecutionCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+
+        size_t nMaxCacheSize = GetSigCacheBytesPerCache();
+        size_t nElems = setValid.setup_bytes(nMaxCacheSize);
+        LogPrintf("Using %zu MiB out of %zu/2 requested for script execution cache, able to store %zu elements\n",
+                  (nElems * sizeof(uint256)) >> 20, (nMaxCacheSize * 2) >> 20, nElems);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& txid, unsigned int flags) const
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(txid.begin(), 32).Write((const unsigned char*)&flags, sizeof(flags)).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, bool erase) const
+    {
+        return setValid.contains(entry, erase);
+    }
+
+    void Set(const uint256& entry)
+    {
+        setValid.insert(entry);
+    }
+};
+
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase())
     {
@@ -2330,13 +2488,30 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // First check if script executions have been cached with the same
+            // flags. A hit made while connecting a block (no store requested)
+            // lets the entry be evicted, as the transaction won't be seen again.
+            static CScriptExecutionCache scriptExecutionCache;
+            uint256 hashCacheEntry;
+            AssertLockHeld(cs_main);
+            scriptExecutionCache.ComputeEntry(hashCacheEntry, tx.GetHash(), flags);
+            if (scriptExecutionCache.Get(hashCacheEntry, !cacheFullScriptStore))
+                return true;
+
+            // The checks of all inputs share one precomputed serialization
+            // for their signature hashes; with a single input it wouldn't
+            // save anything.
+            std::shared_ptr<const PrecomputedTransactionData> txdata;
+            if (tx.vin.size() > 1)
+                txdata = std::make_shared<PrecomputedTransactionData>(tx);
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(*coins, tx, i, flags, cacheSigStore, txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -2349,7 +2524,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -2363,6 +2538,12 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            if (cacheFullScriptStore && !pvChecks) {
+                // We executed all of the provided scripts, and were told to
+                // cache the result. Do so now.
+                scriptExecutionCache.Set(hashCacheEntry);
+            }
         }
     }
 
@@ -2620,6 +2801,9 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+        if (!pblocktree->EraseAddressTxNumbers(addressIndex)) {
+            return AbortNode(state, "Failed to delete address index tx numbers");
+        }
     }
 
     return fClean;
@@ -2650,13 +2834,17 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("credits-scriptch");
     scriptcheckqueue.Thread();
 }
 
+void GetScriptCheckQueueStats(CScriptCheckQueueStats& stats)
+{
+    scriptcheckqueue.GetStats(stats.nPending, stats.nPeak, stats.nTotal);
+    stats.nMempoolTxs = nMempoolScriptCheckTxs;
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2774,6 +2962,18 @@ public:
 // Protected by cs_main
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
+// BIP16 didn't become active until Apr 1 2012
+static const int64_t nBIP16SwitchTime = 1333238400;
+
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindex)
+{
+    unsigned int flags = (pindex->GetBlockTime() >= nBIP16SwitchTime) ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+    flags |= SCRIPT_VERIFY_DERSIG;
+    flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    return flags;
+}
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
@@ -2782,6 +2982,106 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/**
+ * Add a block to the block filter index. Its filter header commits to the one
+ * of its parent, so a block whose parent is not indexed yet is skipped and left
+ * to ThreadBlockFilterIndex. Entries are keyed by block hash and stay valid when
+ * the block is disconnected again.
+ */
+static bool WriteBlockFilterIndex(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    uint256 hashPrevHeader;
+    if (pindex->pprev) {
+        CBlockFilterIndexEntry prev;
+        if (!pblocktree->ReadBlockFilterIndex(pindex->pprev->GetBlockHash(), prev))
+            return true;
+        hashPrevHeader = prev.hashHeader;
+    }
+
+    CBlockFilter filter(BLOCK_FILTER_BASIC, block, blockundo);
+    CBlockFilterIndexEntry entry;
+    entry.hashFilter = filter.GetHash();
+    entry.hashHeader = filter.ComputeHeader(hashPrevHeader);
+    entry.vchFilter = filter.GetEncodedFilter();
+    return pblocktree->WriteBlockFilterIndex(pindex->GetBlockHash(), entry);
+}
+
+void ThreadBlockFilterIndex()
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+
+    // Walk the active chain from the last block indexed, filling in the blocks
+    // the index misses. Once it reaches the tip every new block's parent is
+    // indexed, and ConnectBlock keeps the index up to date from there.
+    // cs_main is only held to look up the next block; reading it, building its
+    // filter and writing the entry happen without it.
+    int nHeight = 0;
+    int nBuilt = 0;
+    const CBlockIndex* pindexLast = NULL;
+    uint256 hashBest;
+    if (pblocktree->ReadBlockFilterIndexBest(hashBest)) {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+        if (mi != mapBlockIndex.end()) {
+            // Blocks are only indexed after their parent, so the fork point of
+            // the last block indexed and all its ancestors have an entry
+            const CBlockIndex* pindexFork = chainActive.FindFork(mi->second);
+            if (pindexFork)
+                nHeight = pindexFork->nHeight + 1;
+        }
+    }
+    if (nHeight > 0)
+        LogPrintf("%s: resuming block filter index at height %d\n", __func__, nHeight);
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        const CBlockIndex* pindex;
+        CDiskBlockPos posBlock, posUndo;
+        {
+            LOCK(cs_main);
+            // Step back to the fork point if the chain was reorganized since
+            // the last block was handled
+            if (pindexLast && chainActive[pindexLast->nHeight] != pindexLast)
+                nHeight = chainActive.FindFork(pindexLast)->nHeight + 1;
+            pindex = chainActive[nHeight];
+            if (pindex == NULL) {
+                // Up to date: from now on ConnectBlock indexes every new block
+                // before it becomes the tip, so filters can be served
+                nLocalServices |= NODE_COMPACT_FILTERS;
+                break;
+            }
+            posBlock = pindex->GetBlockPos();
+            posUndo = pindex->GetUndoPos();
+        }
+        pindexLast = pindex;
+        nHeight++;
+
+        if (pblocktree->HaveBlockFilterIndex(pindex->GetBlockHash()))
+            continue;
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, posBlock, consensusParams) || block.GetHash() != pindex->GetBlockHash()) {
+            LogPrintf("%s: failed to read block %s, block filter index not built\n", __func__, pindex->GetBlockHash().ToString());
+            return;
+        }
+        CBlockUndo blockundo;
+        if (pindex->pprev) {
+            if (posUndo.IsNull() || !UndoReadFromDisk(blockundo, posUndo, pindex->pprev->GetBlockHash())) {
+                LogPrintf("%s: failed to read undo data of block %s, block filter index not built\n", __func__, pindex->GetBlockHash().ToString());
+                return;
+            }
+        }
+        if (!WriteBlockFilterIndex(block, blockundo, pindex)) {
+            LogPrintf("%s: failed to write block filter index\n", __func__);
+            return;
+        }
+        if (++nBuilt % 10000 == 0)
+            LogPrintf("%s: built block filters up to height %d\n", __func__, pindex->nHeight);
+    }
+
+    LogPrintf("%s: block filter index up to date at height %d, %d filters built\n", __func__, nHeight - 1, nBuilt);
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, const bool fWriteNames)
 {
     const CChainParams& chainparams = Params();
@@ -2800,8 +3100,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Special case for the genesis block, skipping connection of its transactions
     // (its coinbase is unspendable)
     if (block.GetHash() == chainparams.GetConsensus().hashGenesisBlock) {
-        if (!fJustCheck)
+        if (!fJustCheck) {
             view.SetBestBlock(pindex->GetBlockHash());
+            if (fBlockFilterIndex && !WriteBlockFilterIndex(block, CBlockUndo(), pindex))
+                return AbortNode(state, "Failed to write block filter index");
+        }
         return true;
     }
 
@@ -2852,16 +3155,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }*/
 
-    // BIP16 didn't become active until Apr 1 2012
-    int64_t nBIP16SwitchTime = 1333238400;
     bool fStrictPayToScriptHash = (pindex->GetBlockTime() >= nBIP16SwitchTime);
 
     int nLockTimeFlags = 0;
 
-    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
-        flags |= SCRIPT_VERIFY_DERSIG;
-        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    unsigned int flags = GetBlockScriptFlags(pindex);
         nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
 
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
@@ -2914,7 +3212,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 auto itByPrev = mapOrphanTransactionsByPrev.find(tx.vin[j].prevout);
                 if (itByPrev == mapOrphanTransactionsByPrev.end()) continue;
                 for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
-                    const CTransaction& orphanTx = (*mi)->second.tx;
+                    const CTransaction& orphanTx = *(*mi)->second.tx;
                     const uint256& orphanHash = orphanTx.GetHash();
                     vOrphanErase.push_back(orphanHash);
                 }
@@ -2977,7 +3275,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
@@ -3104,6 +3402,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
             return AbortNode(state, "Failed to write timestamp index");
 
+    if (fBlockFilterIndex)
+        if (!WriteBlockFilterIndex(block, blockundo, pindex))
+            return AbortNode(state, "Failed to write block filter index");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3251,6 +3553,167 @@ void PruneAndFlush() {
     FlushStateToDisk(state, FLUSH_STATE_NONE);
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+bool LoadMempool()
+{
+    const CChainParams& chainparams = Params();
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t count = 0;
+    int64_t skipped = 0;
+    int64_t failed = 0;
+    int64_t nNow = GetTime();
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION) {
+            return false;
+        }
+        uint64_t num;
+        file >> num;
+
+        // Restore the prioritisations first, so that they already count when
+        // the transactions are accepted.
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+        for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); it++) {
+            mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+        }
+
+        int nLastProgress = -1;
+        for (uint64_t i = 0; i < num; i++) {
+            CTransaction tx;
+            int64_t nTime;
+            bool fLockRequest;
+            file >> tx;
+            file >> nTime;
+            file >> fLockRequest;
+
+            int nProgress = num > 0 ? (int)(i * 100 / num) : 100;
+            if (nProgress / 10 != nLastProgress / 10) {
+                LogPrintf("Loading mempool... %d%%\n", nProgress);
+            }
+            if (nProgress != nLastProgress) {
+                uiInterface.ShowProgress(_("Loading mempool..."), nProgress);
+                nLastProgress = nProgress;
+            }
+
+            if (nTime + nExpiryTimeout <= nNow) {
+                ++skipped;
+                continue;
+            }
+
+            // Lock requests go through the same steps as when they are
+            // received from a peer, so they keep collecting votes.
+            CTxLockRequest txLockRequest(tx);
+            if (fLockRequest && fEnableInstantSend && !instantsend.ProcessTxLockRequest(txLockRequest)) {
+                fLockRequest = false;
+            }
+
+            CValidationState state;
+            LOCK(cs_main);
+            if (mempool.exists(tx.GetHash())) {
+                ++skipped;
+            } else if (AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime)) {
+                if (fLockRequest && fEnableInstantSend)
+                    instantsend.AcceptLockRequest(txLockRequest);
+                ++count;
+            } else {
+                ++failed;
+            }
+
+            if (ShutdownRequested())
+                break;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        uiInterface.ShowProgress("", 100);
+        return false;
+    }
+    uiInterface.ShowProgress("", 100);
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired or already present\n", count, failed, skipped);
+    return !ShutdownRequested();
+}
+
+/** Orders mempool entries so that every transaction comes after the ones it spends */
+struct CompareTxMemPoolEntryByAncestorCount
+{
+    bool operator()(CTxMemPool::txiter a, CTxMemPool::txiter b) const
+    {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    }
+};
+
+void DumpMempool()
+{
+    int64_t start = GetTimeMicros();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<std::pair<CTransactionRef, int64_t> > vTx;
+
+    {
+        LOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+        // LoadMempool accepts the transactions in file order, so write
+        // parents before their children.
+        std::vector<CTxMemPool::txiter> vEntries;
+        vEntries.reserve(mempool.mapTx.size());
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); it++) {
+            vEntries.push_back(it);
+        }
+        std::stable_sort(vEntries.begin(), vEntries.end(), CompareTxMemPoolEntryByAncestorCount());
+        vTx.reserve(vEntries.size());
+        BOOST_FOREACH(CTxMemPool::txiter it, vEntries) {
+            vTx.push_back(std::make_pair(it->GetSharedTx(), it->GetTime()));
+        }
+    }
+
+    // Look up lock requests without holding mempool.cs, instantsend locks
+    // cs_instantsend after cs_main.
+    std::vector<bool> vLockRequest(vTx.size(), false);
+    for (size_t i = 0; i < vTx.size(); i++) {
+        vLockRequest[i] = instantsend.HasTxLockRequest(vTx[i].first->GetHash());
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "mempool.dat.new").string().c_str(), "wb");
+        if (!filestr) {
+            return;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+
+        file << (uint64_t)vTx.size();
+        file << mapDeltas;
+        for (size_t i = 0; i < vTx.size(); i++) {
+            file << *vTx[i].first;
+            file << vTx[i].second;
+            file << (bool)vLockRequest[i];
+        }
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*0.000001, (last-mid)*0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+    }
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew) {
     const CChainParams& chainParams = Params();
@@ -3312,8 +3775,54 @@ void static UpdateTip(CBlockIndex *pindexNew) {
     LogPrintf("\n");
 }
 
-/** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size after this, with cs_main held. */
-bool static DisconnectTip(CValidationState& state, const Consensus::Params& consensusParams)
+static int64_t nTimeReorgMempool = 0;
+
+/**
+ * Add the transactions queued in disconnectpool back to the mempool, or when
+ * fAddToMempool is false only evict their in-mempool descendants, then bring
+ * the mempool in line with the new tip. Runs once per reorg rather than once
+ * per disconnected block.
+ */
+static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool, bool fAddToMempool)
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMicros();
+    std::vector<CTransactionRef> vtx;
+    disconnectpool.takeInMempoolOrder(vtx);
+    std::vector<uint256> vHashUpdate;
+    BOOST_FOREACH(const CTransactionRef& ptx, vtx) {
+        // ignore validation errors in resurrected transactions
+        std::list<CTransaction> removed;
+        CValidationState stateDummy;
+        if (!fAddToMempool || ptx->IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, *ptx, false, NULL, true)) {
+            mempool.remove(*ptx, removed, true);
+        } else if (mempool.exists(ptx->GetHash())) {
+            vHashUpdate.push_back(ptx->GetHash());
+        }
+    }
+    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
+    // no in-mempool children, which is generally not true when adding
+    // previously-confirmed transactions back to the mempool.
+    // UpdateTransactionsFromBlock finds descendants of any transactions in the
+    // disconnected blocks that were added back and cleans up the mempool state.
+    mempool.UpdateTransactionsFromBlock(vHashUpdate);
+
+    // We also need to remove any now-immature transactions
+    mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+    // Re-limit mempool size, in case we added any transactions
+    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+
+    int64_t nTime = GetTimeMicros() - nStart; nTimeReorgMempool += nTime;
+    LogPrint("bench", "- Mempool reorg: %.2fms (%u txs, %u re-added) [%.2fs]\n",
+             nTime * 0.001, vtx.size(), vHashUpdate.size(), nTimeReorgMempool * 0.000001);
+}
+
+/**
+ * Disconnect chainActive's tip, with cs_main held. The block's transactions
+ * are queued in disconnectpool; call UpdateMempoolForReorg once all blocks
+ * of the reorg have been disconnected and connected.
+ */
+bool static DisconnectTip(CValidationState& state, const Consensus::Params& consensusParams, DisconnectedBlockTransactions& disconnectpool)
 {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
@@ -3333,24 +3842,18 @@ bool static DisconnectTip(CValidationState& state, const Consensus::Params& cons
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
-    // Resurrect mempool transactions from the disconnected block.
-    std::vector<uint256> vHashUpdate;
-    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
-        // ignore validation errors in resurrected transactions
+    // Queue the block's transactions to be added back to the mempool. They
+    // are queued in reverse, see DisconnectedBlockTransactions.
+    BOOST_REVERSE_FOREACH(const CTransaction &tx, block.vtx) {
+        disconnectpool.addTransaction(MakeTransactionRef(tx));
+    }
+    while (disconnectpool.CreditsMemoryUsage() > MAX_DISCONNECTED_TX_POOL_SIZE * 1000) {
+        // Drop the transactions of the highest disconnected blocks first;
+        // anything in the mempool spending them has to go as well.
+        CTransactionRef ptx = disconnectpool.removeNewest();
         std::list<CTransaction> removed;
-        CValidationState stateDummy;
-        if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, true)) {
-            mempool.remove(tx, removed, true);
-        } else if (mempool.exists(tx.GetHash())) {
-            vHashUpdate.push_back(tx.GetHash());
-        }
+        mempool.remove(*ptx, removed, true);
     }
-    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
-    // no in-mempool children, which is generally not true when adding
-    // previously-confirmed transactions back to the mempool.
-    // UpdateTransactionsFromBlock finds descendants of any transactions in this
-    // block that were added back and cleans up the mempool state.
-    mempool.UpdateTransactionsFromBlock(vHashUpdate);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
     // Let wallets know transactions went from 1-confirmed to
@@ -3371,7 +3874,7 @@ static int64_t nTimePostConnect = 0;
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
  */
-bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock)
+bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock, DisconnectedBlockTransactions& disconnectpool)
 {
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
@@ -3410,6 +3913,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     // Remove conflicting transactions from the mempool.
     std::list<CTransaction> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload());
+    disconnectpool.removeForBlock(pblock->vtx);
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
     // Tell wallet about transactions that went from mempool
@@ -3436,11 +3940,14 @@ bool DisconnectBlocks(int blocks)
     const CChainParams& chainparams = Params();
 
     LogPrintf("DisconnectBlocks -- Got command to replay %d blocks\n", blocks);
+    DisconnectedBlockTransactions disconnectpool;
     for(int i = 0; i < blocks; i++) {
-        if(!DisconnectTip(state, chainparams.GetConsensus()) || !state.IsValid()) {
+        if(!DisconnectTip(state, chainparams.GetConsensus(), disconnectpool) || !state.IsValid()) {
+            UpdateMempoolForReorg(disconnectpool, false);
             return false;
         }
     }
+    UpdateMempoolForReorg(disconnectpool, true);
 
     return true;
 }
@@ -3554,9 +4061,14 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
 
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
+    DisconnectedBlockTransactions disconnectpool;
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(state, chainparams.GetConsensus()))
+        if (!DisconnectTip(state, chainparams.GetConsensus(), disconnectpool)) {
+            // This is likely a fatal error, but keep the mempool consistent,
+            // just in case. Only remove from the mempool in this case.
+            UpdateMempoolForReorg(disconnectpool, false);
             return false;
+        }
         fBlocksDisconnected = true;
     }
 
@@ -3579,7 +4091,7 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
 
         // Connect new blocks.
         BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
+            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -3590,6 +4102,9 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
                     break;
                 } else {
                     // A system error occurred (disk space, database error, ...).
+                    // Make the mempool consistent with the current tip, just in case
+                    // any observers try to use it before shutdown.
+                    UpdateMempoolForReorg(disconnectpool, false);
                     return false;
                 }
             } else {
@@ -3604,8 +4119,9 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
     }
 
     if (fBlocksDisconnected) {
-        mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
-        LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        // If any blocks were disconnected, disconnectpool may be non empty. Add
+        // any disconnected transactions back to the mempool.
+        UpdateMempoolForReorg(disconnectpool, true);
     }
     mempool.check(pcoinsTip);
 
@@ -3741,6 +4257,7 @@ bool InvalidateBlock(CValidationState& state, const Consensus::Params& consensus
     setDirtyBlockIndex.insert(pindex);
     setBlockIndexCandidates.erase(pindex);
 
+    DisconnectedBlockTransactions disconnectpool;
     while (chainActive.Contains(pindex)) {
         CBlockIndex *pindexWalk = chainActive.Tip();
         pindexWalk->nStatus |= BLOCK_FAILED_CHILD;
@@ -3748,13 +4265,17 @@ bool InvalidateBlock(CValidationState& state, const Consensus::Params& consensus
         setBlockIndexCandidates.erase(pindexWalk);
         // ActivateBestChain considers blocks already in chainActive
         // unconditionally valid already, so force disconnect away from it.
-        if (!DisconnectTip(state, consensusParams)) {
-            mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+        if (!DisconnectTip(state, consensusParams, disconnectpool)) {
+            // It's probably hopeless to try to make the mempool consistent
+            // here if DisconnectTip failed, but we can try.
+            UpdateMempoolForReorg(disconnectpool, false);
             return false;
         }
     }
 
-    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    // DisconnectTip will add transactions to disconnectpool; try to add these
+    // back to the mempool.
+    UpdateMempoolForReorg(disconnectpool, true);
 
     // The resulting new best tip may not be in setBlockIndexCandidates anymore, so
     // add it again.
@@ -3767,7 +4288,6 @@ bool InvalidateBlock(CValidationState& state, const Consensus::Params& consensus
     }
 
     InvalidChainFound(pindex);
-    mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
     uiInterface.NotifyBlockTip(IsInitialBlockDownload(), pindex->pprev);
     return true;
 }
@@ -4618,6 +5138,9 @@ bool static LoadBlockIndexDB()
     // Check whether we have an address index
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+    bool fCompactAddressIndex = false;
+    pblocktree->ReadFlag("compactaddressindex", fCompactAddressIndex);
+    pblocktree->SetCompactAddressIndex(fCompactAddressIndex);
 
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
@@ -4796,6 +5319,8 @@ bool InitBlockIndex(const CChainParams& chainparams)
     // Use the provided setting for -addressindex in the new database
     fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
     pblocktree->WriteFlag("addressindex", fAddressIndex);
+    pblocktree->SetCompactAddressIndex(GetBoolArg("-compactaddressindex", DEFAULT_COMPACTADDRESSINDEX));
+    pblocktree->WriteFlag("compactaddressindex", pblocktree->IsCompactAddressIndex());
 
     // Use the provided setting for -timestampindex in the new database
     fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
@@ -5280,6 +5805,14 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/**
+ * Bloom filter elements of the transactions of the last block served as a
+ * merkleblock, so that every filtered peer fetching a new block can share them.
+ * Protected by cs_main.
+ */
+static uint256 hashFilteredBlockElements;
+static std::vector<CBloomFilterTxElements> vFilteredBlockElements;
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -5348,7 +5881,15 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                             LOCK(pfrom->cs_filter);
                             if (pfrom->pfilter) {
                                 sendMerkleBlock = true;
-                                merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                                if (hashFilteredBlockElements != block.GetHash()) {
+                                    std::vector<CBloomFilterTxElements> vElements;
+                                    vElements.reserve(block.vtx.size());
+                                    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+                                        vElements.push_back(CBloomFilterTxElements(tx));
+                                    vFilteredBlockElements.swap(vElements);
+                                    hashFilteredBlockElements = block.GetHash();
+                                }
+                                merkleBlock = CMerkleBlock(block, vFilteredBlockElements, *pfrom->pfilter);
                             }
                         }
                         if (sendMerkleBlock) {
@@ -5386,25 +5927,28 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 bool pushed = false;
 
                 {
-                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    CTransactionRef ptx;
                     {
                         LOCK(cs_mapRelay);
-                        std::map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                        if (mi != mapRelay.end()) {
-                            ss += (*mi).second;
-                            pushed = true;
-                        }
+                        std::map<CInv, CTransactionRef>::iterator mi = mapRelay.find(inv);
+                        if (mi != mapRelay.end())
+                            ptx = mi->second;
                     }
-                    if(pushed)
+                    if (ptx) {
+                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                        ss.reserve(1000);
+                        ss << *ptx;
                         pfrom->PushMessage(inv.GetCommand(), ss);
+                        pushed = true;
+                    }
                 }
 
                 if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
+                    CTransactionRef ptx = mempool.get(inv.hash);
+                    if (ptx) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << tx;
+                        ss << *ptx;
                         pfrom->PushMessage(NetMsgType::TX, ss);
                         pushed = true;
                     }
@@ -5575,6 +6119,41 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     }
 }
 
+/**
+ * Check a request for the block filters of the blocks at heights nStartHeight
+ * to that of hashStop, and look up the stop block. A peer that asks for more
+ * than nMaxHeightRange blocks, for a filter type or a block we do not know, or
+ * for filters we do not serve is disconnected.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, uint8_t nFilterType, uint32_t nStartHeight, const uint256& hashStop,
+                                      uint32_t nMaxHeightRange, const CBlockIndex*& pindexStop)
+{
+    AssertLockHeld(cs_main);
+
+    if (!(nLocalServices & NODE_COMPACT_FILTERS) || nFilterType != BLOCK_FILTER_BASIC) {
+        LogPrint("net", "peer %d requested unsupported block filter type %d\n", pfrom->id, nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+        LogPrint("net", "peer %d requested block filters up to unknown block %s\n", pfrom->id, hashStop.ToString());
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    pindexStop = mi->second;
+
+    uint32_t nStopHeight = pindexStop->nHeight;
+    if (nStartHeight > nStopHeight || nStopHeight - nStartHeight >= nMaxHeightRange) {
+        LogPrint("net", "peer %d requested block filters of invalid height range %d to %d\n", pfrom->id, nStartHeight, nStopHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    return true;
+}
+
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     const CChainParams& chainparams = Params();
@@ -6033,6 +6612,94 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
+    else if (strCommand == NetMsgType::GETCFILTERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        LOCK(cs_main);
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, pindexStop))
+            return true;
+
+        // The filters are sent as stored in the index, without reading or
+        // decoding anything per peer
+        std::vector<std::pair<uint256, CBlockFilterIndexEntry> > vEntries(pindexStop->nHeight - nStartHeight + 1);
+        for (int nHeight = nStartHeight; nHeight <= pindexStop->nHeight; nHeight++) {
+            std::pair<uint256, CBlockFilterIndexEntry>& entry = vEntries[nHeight - nStartHeight];
+            entry.first = chainActive[nHeight]->GetBlockHash();
+            if (!GetBlockFilterIndex(entry.first, entry.second)) {
+                LogPrint("net", "block filter index does not have block %s yet, ignoring getcfilters from peer=%d\n", entry.first.ToString(), pfrom->id);
+                return true;
+            }
+        }
+        for (unsigned int i = 0; i < vEntries.size(); i++)
+            pfrom->PushMessage(NetMsgType::CFILTER, nFilterType, vEntries[i].first, vEntries[i].second.vchFilter);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFHEADERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        LOCK(cs_main);
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, pindexStop))
+            return true;
+
+        CBlockFilterIndexEntry entry;
+        uint256 hashPrevHeader;
+        if (nStartHeight > 0) {
+            if (!GetBlockFilterIndex(chainActive[nStartHeight - 1]->GetBlockHash(), entry)) {
+                LogPrint("net", "block filter index is not built up to height %d yet, ignoring getcfheaders from peer=%d\n", nStartHeight - 1, pfrom->id);
+                return true;
+            }
+            hashPrevHeader = entry.hashHeader;
+        }
+
+        std::vector<uint256> vFilterHashes;
+        vFilterHashes.reserve(pindexStop->nHeight - nStartHeight + 1);
+        for (int nHeight = nStartHeight; nHeight <= pindexStop->nHeight; nHeight++) {
+            if (!GetBlockFilterIndex(chainActive[nHeight]->GetBlockHash(), entry)) {
+                LogPrint("net", "block filter index is not built up to height %d yet, ignoring getcfheaders from peer=%d\n", nHeight, pfrom->id);
+                return true;
+            }
+            vFilterHashes.push_back(entry.hashFilter);
+        }
+        pfrom->PushMessage(NetMsgType::CFHEADERS, nFilterType, hashStop, hashPrevHeader, vFilterHashes);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT)
+    {
+        uint8_t nFilterType;
+        uint256 hashStop;
+        vRecv >> nFilterType >> hashStop;
+
+        LOCK(cs_main);
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, 0, hashStop, std::numeric_limits<uint32_t>::max(), pindexStop))
+            return true;
+
+        std::vector<uint256> vHeaders;
+        vHeaders.reserve(pindexStop->nHeight / CFCHECKPT_INTERVAL);
+        for (int nHeight = CFCHECKPT_INTERVAL; nHeight <= pindexStop->nHeight; nHeight += CFCHECKPT_INTERVAL) {
+            CBlockFilterIndexEntry entry;
+            if (!GetBlockFilterIndex(chainActive[nHeight]->GetBlockHash(), entry)) {
+                LogPrint("net", "block filter index is not built up to height %d yet, ignoring getcfcheckpt from peer=%d\n", nHeight, pfrom->id);
+                return true;
+            }
+            vHeaders.push_back(entry.hashHeader);
+        }
+        pfrom->PushMessage(NetMsgType::CFCHECKPT, nFilterType, hashStop, vHeaders);
+    }
+
+
     else if (strCommand == NetMsgType::TX || strCommand == NetMsgType::PSTX || strCommand == NetMsgType::TXLOCKREQUEST)
     {
         // Stop processing the transaction early if
@@ -6147,7 +6814,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                      mi != itByPrev->second.end();
                      ++mi)
                 {
-                    const CTransaction& orphanTx = (*mi)->second.tx;
+                    const CTransaction& orphanTx = *(*mi)->second.tx;
                     const uint256& orphanHash = orphanTx.GetHash();
                     NodeId fromPeer = (*mi)->second.fromPeer;
                     bool fMissingInputs2 = false;
@@ -6207,7 +6874,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                     pfrom->AddInventoryKnown(inv);
                     if (!AlreadyHave(inv)) pfrom->AskFor(inv);
                 }
-                AddOrphanTx(tx, pfrom->GetId());
+                AddOrphanTx(MakeTransactionRef(tx), pfrom->GetId());
 
                 // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
                 unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
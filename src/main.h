@@ -24,6 +24,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -42,7 +43,9 @@ class CValidationInterface;
 class CValidationState;
 
 struct LockPoints;
+struct CBlockFilterIndexEntry;
 struct CNodeStateStats;
+struct PrecomputedTransactionData;
 
 /** Default for accepting alerts from the P2P network. */
 static const bool DEFAULT_ALERTS = true;
@@ -73,6 +76,10 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 100;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 404;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Maximum kilobytes of transactions from disconnected blocks kept for re-adding to the mempool during a reorg */
+static const unsigned int MAX_DISCONNECTED_TX_POOL_SIZE = 20000;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x20000000; // 512 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -81,7 +88,7 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x4000000; // 64 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x400000; // 4 MiB
 
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 64;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
@@ -91,6 +98,12 @@ static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Maximum number of blocks whose filters are sent in reply to one getcfilters message. */
+static const unsigned int MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of filter hashes sent in one cfheaders message. */
+static const unsigned int MAX_GETCFHEADERS_SIZE = 2000;
+/** Distance between the filter headers sent in a cfcheckpt message. */
+static const int CFCHECKPT_INTERVAL = 1000;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
@@ -123,8 +136,10 @@ static const unsigned int DEFAULT_BYTES_PER_SIGOP = 20;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = true;
 static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_COMPACTADDRESSINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 static const bool DEFAULT_TESTSAFEMODE = false;
@@ -233,6 +248,7 @@ extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fBlockFilterIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern unsigned int nBytesPerSigOp;
@@ -314,6 +330,26 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/**
+ * Add the blocks connected before -blockfilterindex was enabled to the block
+ * filter index, resuming after the last block indexed, then advertise
+ * NODE_COMPACT_FILTERS.
+ */
+void ThreadBlockFilterIndex();
+
+struct CScriptCheckQueueStats
+{
+    //! Number of script verifications queued but not yet finished
+    unsigned int nPending;
+    //! Largest number of outstanding script verifications seen
+    unsigned int nPeak;
+    //! Total number of script verifications handed to the queue
+    uint64_t nTotal;
+    //! Number of mempool transactions whose scripts were verified on the queue
+    uint64_t nMempoolTxs;
+};
+/** Get the depth and throughput counters of the script checking queue */
+void GetScriptCheckQueueStats(CScriptCheckQueueStats& stats);
 
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
@@ -368,10 +404,20 @@ void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 
+/** Dump the mempool, with fee deltas and InstantSend lock requests, to disk. */
+void DumpMempool();
+
+/** Load the mempool from disk. Returns false on failure or when interrupted by shutdown. */
+bool LoadMempool();
+
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fOverrideMempoolLimit=false, bool fRejectAbsurdFee=false, bool fDryRun=false);
 
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit=false, bool fRejectAbsurdFee=false, bool fDryRun=false);
+
 int GetUTXOHeight(const COutPoint& outpoint);
 int GetInputAge(const CTxIn &txin);
 int GetInputAgeIX(const uint256 &nTXHash, const CTxIn &txin);
@@ -710,9 +756,17 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
  * instead of being performed inline.
+ *
+ * If the transaction's scripts were already found valid with the same flags and stored in the
+ * script execution cache, no script checks are performed or pushed at all. cacheSigStore stores
+ * individual signatures in the signature cache; cacheFullScriptStore records the transaction in
+ * the script execution cache once all of its scripts were executed inline.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks = NULL);
+                 unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, std::vector<CScriptCheck> *pvChecks = NULL);
+
+/** Script verification flags that the scripts in block pindex are checked with */
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindex);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, int nHeight);
@@ -772,12 +826,15 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    //! Signature hash data shared by the checks of all inputs of ptxTo, if any
+    std::shared_ptr<const PrecomputedTransactionData> txdata;
 
 public:
     CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) :
+    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn,
+                 const std::shared_ptr<const PrecomputedTransactionData>& txdataIn = std::shared_ptr<const PrecomputedTransactionData>()) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
 
@@ -788,16 +845,33 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        txdata.swap(check.txdata);
     }
 
     ScriptError GetScriptError() const { return error; }
 };
 
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes);
+/** Get the block filter index entry of a block, false if the index does not have it (yet). */
+bool GetBlockFilterIndex(const uint256 &hashBlock, CBlockFilterIndexEntry &entry);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+/** Batched GetSpentIndex: vFound tells which of the keys were found in the mempool or the spent index. */
+bool GetSpentIndex(const std::vector<CSpentIndexKey> &keys, std::vector<CSpentIndexValue> &values, std::vector<bool> &vFound);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
+/** Get the address index entries of several addresses merged in (height, txindex) order,
+ *  stopping after nMaxTxs distinct transactions (0 for no limit). The heights are only
+ *  limited to [start, end] when both are set, as for the single address queries. */
+bool GetAddressIndex(const std::vector<std::pair<uint160, int> > &addresses,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                     int start = 0, int end = 0, unsigned int nMaxTxs = 0);
+/** Cut address index entries read with a limit of nMaxTxs + 1 transactions down to a
+ *  page of at most nMaxTxs, leaving out the last height read, which may be incomplete.
+ *  nNextHeight is set to the height the next page starts at, or 0 if nothing was cut.
+ *  Returns false if the entries of a single height exceed the limit. */
+bool TrimAddressIndexPage(std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                          unsigned int nMaxTxs, int &nNextHeight);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
 
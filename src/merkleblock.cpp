@@ -37,6 +37,34 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CMerkleBlock::CMerkleBlock(const CBlock& block, const std::vector<CBloomFilterTxElements>& vTxElements, CBloomFilter& filter)
+{
+    assert(vTxElements.size() == block.vtx.size());
+
+    header = block.GetBlockHeader();
+
+    std::vector<bool> vMatch;
+    std::vector<uint256> vHashes;
+
+    vMatch.reserve(vTxElements.size());
+    vHashes.reserve(vTxElements.size());
+
+    for (unsigned int i = 0; i < vTxElements.size(); i++)
+    {
+        const uint256& hash = vTxElements[i].hash;
+        if (filter.IsRelevantAndUpdate(vTxElements[i]))
+        {
+            vMatch.push_back(true);
+            vMatchedTxn.push_back(std::make_pair(i, hash));
+        }
+        else
+            vMatch.push_back(false);
+        vHashes.push_back(hash);
+    }
+
+    txn = CPartialMerkleTree(vHashes, vMatch);
+}
+
 CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
 {
     header = block.GetBlockHeader();
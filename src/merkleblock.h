@@ -141,6 +141,12 @@ public:
      */
     CMerkleBlock(const CBlock& block, CBloomFilter& filter);
 
+    /**
+     * Same as above, with the bloom filter elements of each transaction in the
+     * block already extracted, so they can be shared between filtered peers.
+     */
+    CMerkleBlock(const CBlock& block, const std::vector<CBloomFilterTxElements>& vTxElements, CBloomFilter& filter);
+
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids);
 
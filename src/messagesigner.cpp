@@ -4,12 +4,64 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "cuckoocache.h"
 #include "hash.h"
 #include "main.h" // For strMessageMagic
 #include "messagesigner.h"
+#include "random.h"
+#include "script/sigcache.h"
 #include "tinyformat.h"
+#include "util.h"
 #include "utilstrencodings.h"
 
+#include <boost/thread.hpp>
+
+namespace {
+
+/**
+ * Cache of compact signatures that verified, keyed by
+ * SHA256(nonce || hash || public key || signature). Only valid results are
+ * stored, so an entry can't be used to make a bad signature pass.
+ */
+class CHashSignatureCache
+{
+private:
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    boost::shared_mutex cs_cache;
+
+public:
+    CHashSignatureCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        // If -maxmsgsigcachesize is set to zero, setup_bytes creates the
+        // minimum possible cache (2 elements).
+        size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxmsgsigcachesize", DEFAULT_MAX_MSG_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+        size_t nElems = setValid.setup_bytes(nMaxCacheSize);
+        LogPrintf("Using %zu MiB for the message signature cache, able to store %zu elements\n",
+                  (nElems * sizeof(uint256)) >> 20, nElems);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_cache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_cache);
+        setValid.insert(entry);
+    }
+};
+
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     CCreditsSecret vchSecret;
@@ -47,18 +99,45 @@ bool CHashSigner::SignHash(const uint256& hash, const CKey key, std::vector<unsi
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
+    static CHashSignatureCache signatureCache;
+
+    if(vchSig.size() != 65) {
+        strErrorRet = "Error recovering public key.";
+        return false;
+    }
+
+    // The signature says whether the key it recovers is compressed, so it
+    // can't recover the expected key if that is encoded the other way.
+    bool fCompressed = ((vchSig[0] - 27) & 4) != 0;
+    if(fCompressed != pubkey.IsCompressed()) {
+        strErrorRet = strprintf("Keys don't match: pubkey=%s is %scompressed, hash=%s, vchSig=%s",
+                    pubkey.GetID().ToString(), pubkey.IsCompressed() ? "" : "un", hash.ToString(),
+                    EncodeBase64(&vchSig[0], vchSig.size()));
+        return false;
+    }
+
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, hash, pubkey, vchSig);
+    if(signatureCache.Get(entry)) {
+        return true;
+    }
+
+    // Recovering the key and comparing it costs about as much as verifying
+    // against the expected key, and unlike a plain verification it also
+    // rejects signatures whose recovery id was altered, as other nodes do.
     CPubKey pubkeyFromSig;
     if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
         strErrorRet = "Error recovering public key.";
         return false;
     }
 
-    if(pubkeyFromSig.GetID() != pubkey.GetID()) {
+    if(pubkeyFromSig != pubkey) {
         strErrorRet = strprintf("Keys don't match: pubkey=%s, pubkeyFromSig=%s, hash=%s, vchSig=%s",
                     pubkey.GetID().ToString(), pubkeyFromSig.GetID().ToString(), hash.ToString(),
                     EncodeBase64(&vchSig[0], vchSig.size()));
         return false;
     }
 
+    signatureCache.Set(entry);
     return true;
 }
\ No newline at end of file
@@ -8,6 +8,10 @@
 
 #include "key.h"
 
+/** Default for -maxmsgsigcachesize, the size of the cache of verified message
+ *  and hash signatures in MiB */
+static const unsigned int DEFAULT_MAX_MSG_SIG_CACHE_SIZE = 4;
+
 /** Helper class for signing messages and checking their signatures
  */
 class CMessageSigner
@@ -28,7 +32,12 @@ class CHashSigner
 public:
     /// Sign the hash, returns true if successful
     static bool SignHash(const uint256& hash, const CKey key, std::vector<unsigned char>& vchSigRet);
-    /// Verify the hash signature, returns true if succcessful
+    /// Verify the hash signature, returns true if succcessful.
+    /// Signatures that verified before are answered from a cache shared by
+    /// all callers, as the same masternode, governance, InstantSend and
+    /// spork messages arrive from many peers.
+    /// The key is deliberately recovered from the signature rather than
+    /// verified directly, so signatures with an altered recovery id fail.
     static bool VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
 };
 
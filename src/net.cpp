@@ -24,6 +24,7 @@
 #include "privatesend.h"
 #include "scheduler.h"
 #include "primitives/transaction.h"
+#include "txmempool.h"
 #include "ui_interface.h"
 #include "utilstrencodings.h"
 #include "wallet/wallet.h"
@@ -44,6 +45,7 @@
 #endif
 
 #include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 
@@ -82,7 +84,7 @@ namespace {
 //
 bool fDiscover = true;
 bool fListen = true;
-uint64_t nLocalServices = NODE_NETWORK;
+std::atomic<uint64_t> nLocalServices(NODE_NETWORK);
 CCriticalSection cs_mapLocalHost;
 std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 static bool vfLimited[NET_MAX] = {};
@@ -96,7 +98,7 @@ std::string strSubVersion;
 
 std::vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-std::map<CInv, CDataStream> mapRelay;
+std::map<CInv, CTransactionRef> mapRelay;
 std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -477,7 +479,7 @@ void CNode::PushVersion()
         LogPrint("net", "send version message: version %d, blocks=%d, us=%s, them=%s, peer=%d\n", PROTOCOL_VERSION, nBestHeight, addrMe.ToString(), addrYou.ToString(), id);
     else
         LogPrint("net", "send version message: version %d, blocks=%d, us=%s, peer=%d\n", PROTOCOL_VERSION, nBestHeight, addrMe.ToString(), id);
-    PushMessage(NetMsgType::VERSION, PROTOCOL_VERSION, nLocalServices, nTime, addrYou, addrMe,
+    PushMessage(NetMsgType::VERSION, PROTOCOL_VERSION, nLocalServices.load(), nTime, addrYou, addrMe,
                 nLocalHostNonce, strSubVersion, nBestHeight, !GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY));
 }
 
@@ -2082,27 +2084,21 @@ void CExplicitNetCleanup::callCleanup()
 }
 
 void RelayTransaction(const CTransaction& tx)
-{
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    uint256 hash = tx.GetHash();
-    CTxLockRequest txLockRequest;
-    if(mapPrivatesendBroadcastTxes.count(hash)) { // MSG_PSTX
-        ss << mapPrivatesendBroadcastTxes[hash];
-    } else if(instantsend.GetTxLockRequest(hash, txLockRequest)) { // MSG_TXLOCK_REQUEST
-        ss << txLockRequest;
-    } else { // MSG_TX
-        ss << tx;
-    }
-    RelayTransaction(tx, ss);
-}
-
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
 {
     uint256 hash = tx.GetHash();
     int nInv = mapPrivatesendBroadcastTxes.count(hash) ? MSG_PSTX :
                 (instantsend.HasTxLockRequest(hash) ? MSG_TXLOCK_REQUEST : MSG_TX);
     CInv inv(nInv, hash);
+
+    // Lock requests serialize exactly like the transaction they wrap, so both
+    // can be answered from a reference to the mempool's copy. PSTX messages
+    // carry a masternode signature and are served from mapPrivatesendBroadcastTxes.
+    CTransactionRef ptx;
+    if (nInv != MSG_PSTX) {
+        ptx = mempool.get(hash);
+        if (!ptx)
+            ptx = MakeTransactionRef(tx);
+    }
     {
         LOCK(cs_mapRelay);
         // Expire old relay messages
@@ -2112,23 +2108,31 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        if (ptx) {
+            mapRelay.insert(std::make_pair(inv, ptx));
+            vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        }
     }
-    LOCK(cs_vNodes);
-    BOOST_FOREACH(CNode* pnode, vNodes)
+    // Taken apart for the first peer with a filter, then matched against the rest.
+    // Filters are matched on a referenced copy of vNodes so that cs_vNodes is
+    // not held while every peer's filter is checked.
+    boost::scoped_ptr<CBloomFilterTxElements> pelements;
+    std::vector<CNode*> vNodesCopy = CopyNodeVector();
+    BOOST_FOREACH(CNode* pnode, vNodesCopy)
     {
         if(!pnode->fRelayTxes)
             continue;
         LOCK(pnode->cs_filter);
         if (pnode->pfilter)
         {
-            if (pnode->pfilter->IsRelevantAndUpdate(tx))
+            if (!pelements)
+                pelements.reset(new CBloomFilterTxElements(tx));
+            if (pnode->pfilter->IsRelevantAndUpdate(*pelements))
                 pnode->PushInventory(inv);
         } else
             pnode->PushInventory(inv);
     }
+    ReleaseNodeVector(vNodesCopy);
 }
 
 void RelayInv(CInv &inv, const int minProtoVersion) {
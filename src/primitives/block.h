@@ -111,7 +111,11 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         READWRITE(*(CBlockHeader*)this);
-        READWRITE(vtx);
+        // Read the transactions without hashing them one by one, then hash
+        // them all together.
+        ::SerReadWrite(s, vtx, nType | SER_NOTXHASH, nVersion, ser_action);
+        if (ser_action.ForRead())
+            CTransaction::UpdateHashes(vtx);
     }
 
     void SetNull()
@@ -8,7 +8,9 @@
 
 #include "primitives/transaction.h"
 
+#include "crypto/sha256.h"
 #include "hash.h"
+#include "streams.h"
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 
@@ -97,6 +99,31 @@ void CTransaction::UpdateHash() const
     *const_cast<uint256*>(&hash) = SerializeHash(*this);
 }
 
+void CTransaction::UpdateHashes(const std::vector<CTransaction>& vtx)
+{
+    if (vtx.empty())
+        return;
+    // Serialize them back to back the way SerializeHash would, then hash
+    // every serialization.
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    std::vector<size_t> vOffsets(vtx.size() + 1);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        vOffsets[i] = ss.size();
+        ss << vtx[i];
+    }
+    vOffsets[vtx.size()] = ss.size();
+    std::vector<const unsigned char*> vInputs(vtx.size());
+    std::vector<size_t> vLens(vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++) {
+        vInputs[i] = (const unsigned char*)&ss[0] + vOffsets[i];
+        vLens[i] = vOffsets[i + 1] - vOffsets[i];
+    }
+    std::vector<uint256> vHashes(vtx.size());
+    SHA256DMulti(vHashes[0].begin(), &vInputs[0], &vLens[0], vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++)
+        *const_cast<uint256*>(&vtx[i].hash) = vHashes[i];
+}
+
 CTransaction::CTransaction() : nVersion(CTransaction::CURRENT_VERSION), vin(), vout(), nLockTime(0) { }
 
 CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime) {
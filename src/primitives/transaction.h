@@ -14,6 +14,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <memory>
+
 // DNS standard information released in 1987.
 // https://tools.ietf.org/html/rfc1035
 // Our Current implementation is missing Type, Class, and TTL (cache time)
@@ -285,10 +287,14 @@ public:
         READWRITE(*const_cast<std::vector<CTxIn>*>(&vin));
         READWRITE(*const_cast<std::vector<CTxOut>*>(&vout));
         READWRITE(*const_cast<uint32_t*>(&nLockTime));
-        if (ser_action.ForRead())
+        if (ser_action.ForRead() && !(nType & SER_NOTXHASH))
             UpdateHash();
     }
 
+    /** Compute the hashes of transactions read with SER_NOTXHASH all at
+     *  once, so they can be computed side by side. */
+    static void UpdateHashes(const std::vector<CTransaction>& vtx);
+
     bool IsNull() const {
         return vin.empty() && vout.empty();
     }
@@ -367,4 +373,13 @@ struct CMutableTransaction
 
 };
 
+/**
+ * A reference counted, immutable transaction. The mempool, the relay memory
+ * and the orphan pool hand these around so that a transaction seen on the
+ * network is kept in memory only once.
+ */
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
+static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
+template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
+
 #endif // CREDITS_PRIMITIVES_TRANSACTION_H
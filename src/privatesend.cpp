@@ -1178,6 +1178,7 @@ bool CPrivatesendPool::SignFinalTransaction(const CTransaction& finalTransaction
     LogPrintf("CPrivatesendPool::SignFinalTransaction -- finalMutableTransaction=%s", finalMutableTransaction.ToString());
 
     std::vector<CTxIn> sigs;
+    std::vector<std::pair<unsigned int, CScript> > vecInputsToSign;
 
     //make sure my inputs/outputs are present, otherwise refuse to sign
     BOOST_FOREACH(const CPrivateSendEntry entry, vecEntries) {
@@ -1223,17 +1224,25 @@ bool CPrivatesendPool::SignFinalTransaction(const CTransaction& finalTransaction
                     return false;
                 }
 
-                const CKeyStore& keystore = *pwalletMain;
+                vecInputsToSign.push_back(std::make_pair(nMyInputIndex, prevPubKey));
+            }
+        }
+    }
 
-                LogPrint("privatesend", "CPrivatesendPool::SignFinalTransaction -- Signing my input %i\n", nMyInputIndex);
-                if(!SignSignature(keystore, prevPubKey, finalMutableTransaction, nMyInputIndex, int(SIGHASH_ALL|SIGHASH_ANYONECANPAY))) { // changes scriptSig
-                    LogPrint("privatesend", "CPrivatesendPool::SignFinalTransaction -- Unable to sign my own transaction!\n");
-                    // not sure what to do here, it will timeout...?
-                }
+    // sign all my inputs at once, all of them were checked above
+    if(!vecInputsToSign.empty()) {
+        const CKeyStore& keystore = *pwalletMain;
 
-                sigs.push_back(finalMutableTransaction.vin[nMyInputIndex]);
-                LogPrint("privatesend", "CPrivatesendPool::SignFinalTransaction -- nMyInputIndex: %d, sigs.size(): %d, scriptSig=%s\n", nMyInputIndex, (int)sigs.size(), ScriptToAsmStr(finalMutableTransaction.vin[nMyInputIndex].scriptSig));
-            }
+        LogPrint("privatesend", "CPrivatesendPool::SignFinalTransaction -- Signing my %d inputs\n", (int)vecInputsToSign.size());
+        if(!SignSignatures(keystore, finalMutableTransaction, vecInputsToSign, int(SIGHASH_ALL|SIGHASH_ANYONECANPAY), GetNumCores())) { // changes scriptSig
+            LogPrint("privatesend", "CPrivatesendPool::SignFinalTransaction -- Unable to sign my own transaction!\n");
+            // not sure what to do here, it will timeout...?
+        }
+
+        for(unsigned int i = 0; i < vecInputsToSign.size(); i++) {
+            int nMyInputIndex = vecInputsToSign[i].first;
+            sigs.push_back(finalMutableTransaction.vin[nMyInputIndex]);
+            LogPrint("privatesend", "CPrivatesendPool::SignFinalTransaction -- nMyInputIndex: %d, sigs.size(): %d, scriptSig=%s\n", nMyInputIndex, (int)sigs.size(), ScriptToAsmStr(finalMutableTransaction.vin[nMyInputIndex].scriptSig));
         }
     }
 
@@ -220,6 +220,33 @@ extern const char *REJECT;
  * @see https://bitcoin.org/en/developer-reference#sendheaders
  */
 extern const char *SENDHEADERS;
+/**
+ * The getcfilters message requests the compact filters of a range of blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by BIP157.
+ */
+extern const char *GETCFILTERS;
+/**
+ * The cfilter message carries the compact filter of one block.
+ */
+extern const char *CFILTER;
+/**
+ * The getcfheaders message requests the filter hashes of a range of blocks,
+ * along with the filter header of the block before them.
+ */
+extern const char *GETCFHEADERS;
+/**
+ * The cfheaders message is the reply to getcfheaders.
+ */
+extern const char *CFHEADERS;
+/**
+ * The getcfcheckpt message requests the filter headers of every
+ * CFCHECKPT_INTERVAL-th block up to a stop block.
+ */
+extern const char *GETCFCHECKPT;
+/**
+ * The cfcheckpt message is the reply to getcfcheckpt.
+ */
+extern const char *CFCHECKPT;
 
 // Credits message types
 // NOTE: do NOT declare non-implmented here, we don't want them to be exposed to the outside
@@ -264,6 +291,9 @@ enum {
     // NODE_BLOOM means the node is capable and willing to handle bloom-filtered connections.
     // Credits nodes used to support this by default, without advertising this bit.
     NODE_BLOOM = (1 << 2),
+    // NODE_COMPACT_FILTERS means the node serves the compact block filters of BIP157/158
+    // from its block filter index (-blockfilterindex).
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
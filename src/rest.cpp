@@ -6,6 +6,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "primitives/block.h"
+#include "base58.h"
+#include "blockfilter.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "main.h"
@@ -24,6 +26,10 @@
 #include <boost/algorithm/string.hpp>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t MAX_REST_ADDRESSES = 100; //allow a max of 100 addresses per /rest/address query
+static const unsigned int MAX_REST_ADDRESS_TXS = 10000; //return the entries of at most about 10000 transactions per /rest/address query
+static const size_t MAX_REST_SPENTINFO_OUTPOINTS = 1000; //allow a max of 1000 outpoints per /rest/spentinfo query
+static const size_t REST_CHUNK_SIZE = 64 * 1024; //send index query results in chunks of about 64 KB
 
 enum RetFormat {
     RF_UNDEF,
@@ -200,6 +206,160 @@ static bool rest_headers(HTTPRequest* req,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_blockfilter(HTTPRequest* req,
+                             const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/blockfilter/<filtertype>/<hash>.<ext>.");
+
+    if (path[0] != "basic")
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + path[0]);
+
+    std::string hashStr = path[1];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    if (!fBlockFilterIndex)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block filters are not available, start with -blockfilterindex");
+
+    CBlockFilterIndexEntry entry;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        if (!GetBlockFilterIndex(hash, entry))
+            return RESTERR(req, HTTP_NOT_FOUND, "Filter of " + hashStr + " not indexed yet");
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        std::string binaryFilter(entry.vchFilter.begin(), entry.vchFilter.end());
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryFilter);
+        return true;
+    }
+
+    case RF_HEX: {
+        std::string strHex = HexStr(entry.vchFilter) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue objFilter(UniValue::VOBJ);
+        objFilter.push_back(Pair("filter", HexStr(entry.vchFilter)));
+        objFilter.push_back(Pair("header", entry.hashHeader.GetHex()));
+        std::string strJSON = objFilter.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_blockfilterheaders(HTTPRequest* req,
+                                    const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/blockfilterheaders/<filtertype>/<count>/<hash>.<ext>.");
+
+    if (path[0] != "basic")
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + path[0]);
+
+    long count = strtol(path[1].c_str(), NULL, 10);
+    if (count < 1 || count > (long)MAX_GETCFHEADERS_SIZE)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[1]);
+
+    std::string hashStr = path[2];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    if (!fBlockFilterIndex)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block filters are not available, start with -blockfilterindex");
+
+    // Filter headers of the blocks of the active chain from hash on, as far
+    // as the index has them
+    std::vector<uint256> vFilterHeaders;
+    vFilterHeaders.reserve(count);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        const CBlockIndex *pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
+        while (pindex != NULL && chainActive.Contains(pindex)) {
+            CBlockFilterIndexEntry entry;
+            if (!GetBlockFilterIndex(pindex->GetBlockHash(), entry))
+                break;
+            vFilterHeaders.push_back(entry.hashHeader);
+            if (vFilterHeaders.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_FOREACH(const uint256& header, vFilterHeaders) {
+        ssHeader << header;
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        std::string binaryHeader = ssHeader.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHeader);
+        return true;
+    }
+
+    case RF_HEX: {
+        std::string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue jsonHeaders(UniValue::VARR);
+        BOOST_FOREACH(const uint256& header, vFilterHeaders) {
+            jsonHeaders.push_back(header.GetHex());
+        }
+        std::string strJSON = jsonHeaders.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -596,6 +756,248 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/** Sends a reply with chunked transfer encoding, so large index query results
+ *  are not built into one UniValue tree or string. The chunks are still
+ *  queued by libevent until the connection takes them, so this does not bound
+ *  memory: callers limit the size of their results. Replies that fit into a
+ *  single chunk are sent normally. */
+class RESTChunkedReply
+{
+private:
+    HTTPRequest* req;
+    std::string strBuffer;
+    bool fStarted;
+
+    void Flush()
+    {
+        if (!fStarted) {
+            req->WriteReplyStart(HTTP_OK);
+            fStarted = true;
+        }
+        req->WriteReplyChunk(strBuffer);
+        strBuffer.clear();
+    }
+
+public:
+    RESTChunkedReply(HTTPRequest* reqIn, const std::string& strContentType) : req(reqIn), fStarted(false)
+    {
+        req->WriteHeader("Content-Type", strContentType);
+    }
+
+    void Write(const std::string& str)
+    {
+        strBuffer += str;
+        if (strBuffer.size() >= REST_CHUNK_SIZE)
+            Flush();
+    }
+
+    void End()
+    {
+        if (!fStarted) {
+            req->WriteReply(HTTP_OK, strBuffer);
+            return;
+        }
+        Flush();
+        req->WriteReplyEnd();
+    }
+};
+
+/** Writes one serialized record in the requested format. JSON output is an array of records. */
+static void WriteRESTRecord(RESTChunkedReply& reply, RetFormat rf, CDataStream& ssRecord, const UniValue& objRecord, bool fFirst)
+{
+    switch (rf) {
+    case RF_BINARY:
+        reply.Write(ssRecord.str());
+        break;
+    case RF_HEX:
+        reply.Write(HexStr(ssRecord.begin(), ssRecord.end()));
+        break;
+    default:
+        reply.Write((fFirst ? "[" : ",") + objRecord.write());
+        break;
+    }
+    ssRecord.clear();
+}
+
+static void EndRESTRecords(RESTChunkedReply& reply, RetFormat rf, bool fEmpty)
+{
+    if (rf == RF_HEX)
+        reply.Write("\n");
+    else if (rf == RF_JSON)
+        reply.Write(fEmpty ? "[]\n" : "]\n");
+    reply.End();
+}
+
+static std::string RESTContentType(RetFormat rf)
+{
+    if (rf == RF_BINARY)
+        return "application/octet-stream";
+    if (rf == RF_HEX)
+        return "text/plain";
+    return "application/json";
+}
+
+static bool rest_address(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() != 1 && path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/address/<address>[,<address>...][/<start>/<end>].<ext>");
+
+    std::vector<std::string> strAddresses;
+    boost::split(strAddresses, path[0], boost::is_any_of(","));
+    if (strAddresses.size() > MAX_REST_ADDRESSES)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max addresses exceeded (max: %d, tried: %d)", MAX_REST_ADDRESSES, strAddresses.size()));
+
+    std::vector<std::pair<uint160, int> > addresses;
+    BOOST_FOREACH(const std::string& strAddress, strAddresses) {
+        CCreditsAddress address(strAddress);
+        uint160 hashBytes;
+        int type = 0;
+        if (!address.GetIndexKey(hashBytes, type))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + strAddress);
+        addresses.push_back(std::make_pair(hashBytes, type));
+    }
+
+    int start = 0;
+    int end = 0;
+    if (path.size() == 3) {
+        start = strtol(path[1].c_str(), NULL, 10);
+        end = strtol(path[2].c_str(), NULL, 10);
+        if (start <= 0 || end < start)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height range: " + path[1] + "/" + path[2]);
+    }
+
+    // Read one transaction more than the limit to tell whether the result
+    // is complete. If it is not, the last height read is left out and the
+    // reply tells where the next page starts.
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!GetAddressIndex(addresses, addressIndex, start, end, MAX_REST_ADDRESS_TXS + 1))
+        return RESTERR(req, HTTP_NOT_FOUND, "No information available for address");
+    int nNextHeight;
+    if (!TrimAddressIndexPage(addressIndex, MAX_REST_ADDRESS_TXS, nNextHeight))
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Too many transactions at height %d (max: %u)", nNextHeight, MAX_REST_ADDRESS_TXS));
+    if (nNextHeight > 0)
+        req->WriteHeader("X-Next-Start-Height", itostr(nNextHeight));
+
+    // Binary records: type (1), address hash (20), height (4), position in
+    // block (4), txid (32), input or output index (4), satoshis (8)
+    RESTChunkedReply reply(req, RESTContentType(rf));
+    CDataStream ssRecord(SER_NETWORK, PROTOCOL_VERSION);
+    for (size_t i = 0; i < addressIndex.size(); i++) {
+        const CAddressIndexKey& key = addressIndex[i].first;
+        UniValue delta(UniValue::VOBJ);
+        if (rf == RF_JSON) {
+            std::string address = key.type == 2 ? CCreditsAddress(CScriptID(key.hashBytes)).ToString() : CCreditsAddress(CKeyID(key.hashBytes)).ToString();
+            delta.push_back(Pair("satoshis", addressIndex[i].second));
+            delta.push_back(Pair("txid", key.txhash.GetHex()));
+            delta.push_back(Pair("index", (int)key.index));
+            delta.push_back(Pair("blockindex", (int)key.txindex));
+            delta.push_back(Pair("height", key.blockHeight));
+            delta.push_back(Pair("address", address));
+        } else {
+            ssRecord << (uint8_t)key.type << key.hashBytes << key.blockHeight << key.txindex << key.txhash << (uint32_t)key.index << addressIndex[i].second;
+        }
+        WriteRESTRecord(reply, rf, ssRecord, delta, i == 0);
+    }
+    EndRESTRecords(reply, rf, addressIndex.empty());
+    return true;
+}
+
+static bool rest_spentinfo(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    std::vector<std::string> strOutpoints;
+    boost::split(strOutpoints, param, boost::is_any_of(","));
+    if (strOutpoints.size() > MAX_REST_SPENTINFO_OUTPOINTS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_REST_SPENTINFO_OUTPOINTS, strOutpoints.size()));
+
+    std::vector<CSpentIndexKey> keys;
+    BOOST_FOREACH(const std::string& strOutpoint, strOutpoints) {
+        size_t pos = strOutpoint.find('-');
+        uint256 txid;
+        if (pos == std::string::npos || !ParseHashStr(strOutpoint.substr(0, pos), txid))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error: " + strOutpoint);
+        int32_t nOutput;
+        if (!ParseInt32(strOutpoint.substr(pos + 1), &nOutput) || nOutput < 0)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error: " + strOutpoint);
+        keys.push_back(CSpentIndexKey(txid, nOutput));
+    }
+
+    std::vector<CSpentIndexValue> values;
+    std::vector<bool> vFound;
+    if (!GetSpentIndex(keys, values, vFound))
+        return RESTERR(req, HTTP_NOT_FOUND, "Spent index not enabled");
+
+    // Binary records, one per requested outpoint: spent flag (1), spending
+    // txid (32), input index (4), height (4); zero when unspent
+    RESTChunkedReply reply(req, RESTContentType(rf));
+    CDataStream ssRecord(SER_NETWORK, PROTOCOL_VERSION);
+    for (size_t i = 0; i < keys.size(); i++) {
+        UniValue obj(UniValue::VNULL);
+        if (rf == RF_JSON) {
+            if (vFound[i]) {
+                obj.setObject();
+                obj.push_back(Pair("txid", values[i].txid.GetHex()));
+                obj.push_back(Pair("index", (int)values[i].inputIndex));
+                obj.push_back(Pair("height", values[i].blockHeight));
+            }
+        } else {
+            CSpentIndexValue value = vFound[i] ? values[i] : CSpentIndexValue();
+            ssRecord << (bool)vFound[i] << value.txid << value.inputIndex << value.blockHeight;
+        }
+        WriteRESTRecord(reply, rf, ssRecord, obj, i == 0);
+    }
+    EndRESTRecords(reply, rf, keys.empty());
+    return true;
+}
+
+static bool rest_blockhashes(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    int32_t high, low;
+    if (path.size() != 2 || !ParseInt32(path[0], &high) || !ParseInt32(path[1], &low) || high < 0 || low < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/blockhashes/<high>/<low>.<ext>");
+
+    std::vector<uint256> blockHashes;
+    if (!GetTimestampIndex(high, low, blockHashes))
+        return RESTERR(req, HTTP_NOT_FOUND, "No information available for block hashes");
+
+    RESTChunkedReply reply(req, RESTContentType(rf));
+    CDataStream ssRecord(SER_NETWORK, PROTOCOL_VERSION);
+    for (size_t i = 0; i < blockHashes.size(); i++) {
+        UniValue hash(UniValue::VSTR);
+        if (rf == RF_JSON)
+            hash.setStr(blockHashes[i].GetHex());
+        else
+            ssRecord << blockHashes[i];
+        WriteRESTRecord(reply, rf, ssRecord, hash, i == 0);
+    }
+    EndRESTRecords(reply, rf, blockHashes.empty());
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -607,7 +1009,12 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blockfilter/", rest_blockfilter},
+      {"/rest/blockfilterheaders/", rest_blockfilterheaders},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/address/", rest_address},
+      {"/rest/spentinfo/", rest_spentinfo},
+      {"/rest/blockhashes/", rest_blockhashes},
 };
 
 bool StartREST()
@@ -182,9 +182,16 @@ UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
     {
-        LOCK(mempool.cs);
+        // Work on a snapshot so that formatting a large reply does not
+        // hold mempool.cs and stall transaction acceptance.
+        std::vector<CTxMemPoolEntry> vEntries;
+        mempool.querySnapshot(vEntries);
+        std::set<uint256> setTxids;
+        BOOST_FOREACH(const CTxMemPoolEntry& e, vEntries)
+            setTxids.insert(e.GetTx().GetHash());
+
         UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+        BOOST_FOREACH(const CTxMemPoolEntry& e, vEntries)
         {
             const uint256& _hash = e.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
@@ -198,11 +205,14 @@ UniValue mempoolToJSON(bool fVerbose = false)
             info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
             info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
             info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
+            info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
+            info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
+            info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
             const CTransaction& tx = e.GetTx();
             std::set<std::string> setDepends;
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
             {
-                if (mempool.exists(txin.prevout.hash))
+                if (setTxids.count(txin.prevout.hash))
                     setDepends.insert(txin.prevout.hash.ToString());
             }
 
@@ -256,6 +266,9 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
             "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
             "    \"descendantfees\" : n,   (numeric) modified fees (see above) of in-mempool descendants (including this one)\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) modified fees (see above) of in-mempool ancestors (including this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -953,6 +966,14 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
     ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
 
+    CScriptCheckQueueStats stats;
+    GetScriptCheckQueueStats(stats);
+    ret.push_back(Pair("scriptcheckthreads", nScriptCheckThreads));
+    ret.push_back(Pair("scriptcheckqueue", (int64_t) stats.nPending));
+    ret.push_back(Pair("scriptcheckpeak", (int64_t) stats.nPeak));
+    ret.push_back(Pair("scriptchecks", (int64_t) stats.nTotal));
+    ret.push_back(Pair("parallelchecked", (int64_t) stats.nMempoolTxs));
+
     return ret;
 }
 
@@ -968,7 +989,12 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"bytes\": xxxxx,              (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
-            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
+            "  \"mempoolminfee\": xxxxx,      (numeric) Minimum fee for tx to be accepted\n"
+            "  \"scriptcheckthreads\": xxxxx, (numeric) Number of script verification threads (-par), 0 if verifying inline\n"
+            "  \"scriptcheckqueue\": xxxxx,   (numeric) Script verifications queued but not yet finished\n"
+            "  \"scriptcheckpeak\": xxxxx,    (numeric) Largest number of outstanding script verifications seen\n"
+            "  \"scriptchecks\": xxxxx,       (numeric) Total script verifications handed to the verification threads\n"
+            "  \"parallelchecked\": xxxxx     (numeric) Mempool transactions whose scripts were verified on the verification threads\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -584,15 +584,19 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         {
             checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
 
+            // cvBlockChange is signalled on every new tip and every transaction
+            // accepted to the mempool. Return as soon as the tip changes, or once
+            // the mempool has changed after the first minute of waiting.
             boost::unique_lock<boost::mutex> lock(csBestBlock);
             while (chainActive.Tip()->GetBlockHash() == hashWatchedChain && IsRPCRunning())
             {
-                if (!cvBlockChange.timed_wait(lock, checktxtime))
-                {
-                    // Timeout: Check transactions for update
+                boost::system_time now = boost::get_system_time();
+                if (now >= checktxtime) {
                     if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
                         break;
-                    checktxtime += boost::posix_time::seconds(10);
+                    cvBlockChange.timed_wait(lock, now + boost::posix_time::seconds(10));
+                } else {
+                    cvBlockChange.timed_wait(lock, checktxtime);
                 }
             }
         }
@@ -614,6 +614,23 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint16
     return true;
 }
 
+unsigned int getAddressLimitFromParams(const UniValue& params)
+{
+    if (!params[0].isObject()) {
+        return 0;
+    }
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (limitValue.isNull()) {
+        return 0;
+    }
+    if (!limitValue.isNum() || limitValue.get_int() < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be a non-negative number");
+    }
+
+    return limitValue.get_int();
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -777,6 +794,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return the deltas of at most this many transactions\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -808,6 +826,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         }
     }
 
+    unsigned int limit = getAddressLimitFromParams(params);
+
     std::vector<std::pair<uint160, int> > addresses;
 
     if (!getAddressesFromParams(params, addresses)) {
@@ -816,16 +836,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
+    if (!GetAddressIndex(addresses, addressIndex, start, end, limit)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
     UniValue result(UniValue::VARR);
@@ -920,6 +932,7 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -948,40 +961,23 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
+    unsigned int limit = getAddressLimitFromParams(params);
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
+    if (!GetAddressIndex(addresses, addressIndex, start, end, limit)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
-    std::set<std::pair<int, std::string> > txids;
     UniValue result(UniValue::VARR);
 
+    // Entries come merged in (height, txindex) order, so all entries of one
+    // transaction are adjacent.
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        int height = it->first.blockHeight;
-        std::string txid = it->first.txhash.GetHex();
-
-        if (addresses.size() > 1) {
-            txids.insert(std::make_pair(height, txid));
-        } else {
-            if (txids.insert(std::make_pair(height, txid)).second) {
-                result.push_back(txid);
-            }
-        }
-    }
-
-    if (addresses.size() > 1) {
-        for (std::set<std::pair<int, std::string> >::const_iterator it=txids.begin(); it!=txids.end(); it++) {
-            result.push_back(it->second);
+        if (it != addressIndex.begin() && it->first.txhash == (it - 1)->first.txhash) {
+            continue;
         }
+        result.push_back(it->first.txhash.GetHex());
     }
 
     return result;
@@ -991,7 +987,7 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
 UniValue getspentinfo(const UniValue& params, bool fHelp)
 {
 
-    if (fHelp || params.size() != 1 || !params[0].isObject())
+    if (fHelp || params.size() != 1 || !(params[0].isObject() || params[0].isArray()))
         throw std::runtime_error(
             "getspentinfo\n"
             "\nReturns the txid and index where an output is spent.\n"
@@ -1000,38 +996,66 @@ UniValue getspentinfo(const UniValue& params, bool fHelp)
             "  \"txid\" (string) The hex string of the txid\n"
             "  \"index\" (number) The start block height\n"
             "}\n"
+            "\nAn array of such objects may be given instead to look up several outputs at once.\n"
             "\nResult:\n"
             "{\n"
             "  \"txid\"  (string) The transaction id\n"
             "  \"index\"  (number) The spending input index\n"
             "  ,...\n"
             "}\n"
+            "\nFor an array of outputs, an array of results in the same order, with null for unspent outputs.\n"
             "\nExamples:\n"
             + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
             + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
         );
 
-    UniValue txidValue = find_value(params[0].get_obj(), "txid");
-    UniValue indexValue = find_value(params[0].get_obj(), "index");
-
-    if (!txidValue.isStr() || !indexValue.isNum()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid txid or index");
+    std::vector<UniValue> outputs;
+    if (params[0].isArray()) {
+        outputs = params[0].getValues();
+    } else {
+        outputs.push_back(params[0]);
     }
 
-    uint256 txid = ParseHashV(txidValue, "txid");
-    int outputIndex = indexValue.get_int();
+    std::vector<CSpentIndexKey> keys;
+    for (std::vector<UniValue>::const_iterator it = outputs.begin(); it != outputs.end(); it++) {
+        if (!it->isObject()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an object with txid and index");
+        }
+        UniValue txidValue = find_value(it->get_obj(), "txid");
+        UniValue indexValue = find_value(it->get_obj(), "index");
 
-    CSpentIndexKey key(txid, outputIndex);
-    CSpentIndexValue value;
+        if (!txidValue.isStr() || !indexValue.isNum()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid txid or index");
+        }
 
-    if (!GetSpentIndex(key, value)) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+        uint256 txid = ParseHashV(txidValue, "txid");
+        int outputIndex = indexValue.get_int();
+        keys.push_back(CSpentIndexKey(txid, outputIndex));
     }
 
-    UniValue obj(UniValue::VOBJ);
-    obj.push_back(Pair("txid", value.txid.GetHex()));
-    obj.push_back(Pair("index", (int)value.inputIndex));
-    obj.push_back(Pair("height", value.blockHeight));
+    std::vector<CSpentIndexValue> values;
+    std::vector<bool> vFound;
+    GetSpentIndex(keys, values, vFound);
 
-    return obj;
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (!vFound[i]) {
+            if (!params[0].isArray()) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+            }
+            result.push_back(NullUniValue);
+            continue;
+        }
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", values[i].txid.GetHex()));
+        obj.push_back(Pair("index", (int)values[i].inputIndex));
+        obj.push_back(Pair("height", values[i].blockHeight));
+        if (!params[0].isArray()) {
+            return obj;
+        }
+        result.push_back(obj);
+    }
+
+    return result;
 }
@@ -67,8 +67,24 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
     entry.push_back(Pair("size", (int)::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION)));
     entry.push_back(Pair("version", tx.nVersion));
     entry.push_back(Pair("locktime", (int64_t)tx.nLockTime));
+
+    // Look up the spent index for all inputs and outputs at once: inputs
+    // come first, followed by the outputs.
+    std::vector<CSpentIndexKey> spentKeys;
+    std::vector<CSpentIndexValue> spentInfos;
+    std::vector<bool> vSpentFound;
+    if (!tx.IsCoinBase()) {
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            spentKeys.push_back(CSpentIndexKey(txin.prevout.hash, txin.prevout.n));
+    }
+    size_t nSpentOutputsPos = spentKeys.size();
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        spentKeys.push_back(CSpentIndexKey(txid, i));
+    GetSpentIndex(spentKeys, spentInfos, vSpentFound);
+
     UniValue vin(UniValue::VARR);
-    BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const CTxIn& txin = tx.vin[i];
         UniValue in(UniValue::VOBJ);
         if (tx.IsCoinBase())
             in.push_back(Pair("coinbase", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
@@ -81,9 +97,8 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
             in.push_back(Pair("scriptSig", o));
 
             // Add address and value info if spentindex enabled
-            CSpentIndexValue spentInfo;
-            CSpentIndexKey spentKey(txin.prevout.hash, txin.prevout.n);
-            if (GetSpentIndex(spentKey, spentInfo)) {
+            if (vSpentFound[i]) {
+                const CSpentIndexValue& spentInfo = spentInfos[i];
                 in.push_back(Pair("value", ValueFromAmount(spentInfo.satoshis)));
                 in.push_back(Pair("valueSat", spentInfo.satoshis));
                 if (spentInfo.addressType == 1) {
@@ -110,9 +125,8 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
         out.push_back(Pair("scriptPubKey", o));
 
         // Add spent information if spentindex is enabled
-        CSpentIndexValue spentInfo;
-        CSpentIndexKey spentKey(txid, i);
-        if (GetSpentIndex(spentKey, spentInfo)) {
+        if (vSpentFound[nSpentOutputsPos + i]) {
+            const CSpentIndexValue& spentInfo = spentInfos[nSpentOutputsPos + i];
             out.push_back(Pair("spentTxId", spentInfo.txid.GetHex()));
             out.push_back(Pair("spentIndex", (int)spentInfo.inputIndex));
             out.push_back(Pair("spentHeight", spentInfo.blockHeight));
@@ -15,7 +15,13 @@
 #include "primitives/transaction.h"
 #include "uint256.h"
 
-typedef std::vector<unsigned char> valtype;
+typedef CScriptStackItem valtype;
+
+/**
+ * Stack space reserved up front by VerifyScript, enough for the common
+ * script types to never grow it.
+ */
+static const unsigned int SCRIPT_STACK_RESERVE = 8;
 
 namespace {
 
@@ -95,7 +101,7 @@ bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
  *
  * This function is consensus-critical since BIP66.
  */
-bool static IsValidSignatureEncoding(const std::vector<unsigned char> &sig) {
+bool static IsValidSignatureEncoding(const valtype &sig) {
     // Format: 0x30 [total-length] 0x02 [R-length] [R] 0x02 [S-length] [S] [sighash]
     // * total-length: 1-byte length descriptor of everything that follows,
     //   excluding the sighash byte.
@@ -183,6 +189,10 @@ bool static IsDefinedHashtypeSignature(const valtype &vchSig) {
 }
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror) {
+    return CheckSignatureEncoding(valtype(vchSig.begin(), vchSig.end()), flags, serror);
+}
+
+bool CheckSignatureEncoding(const valtype &vchSig, unsigned int flags, ScriptError* serror) {
     // Empty signature. Not strictly DER encoded, but allowed to provide a
     // compact way to provide an invalid signature for use with CHECK(MULTI)SIG
     if (vchSig.size() == 0) {
@@ -206,6 +216,16 @@ bool static CheckPubKeyEncoding(const valtype &vchSig, unsigned int flags, Scrip
     return true;
 }
 
+/**
+ * Remove every push of vch from scriptCode. The push is longer than vch
+ * itself, so it can't occur in a script that isn't; that is the common case
+ * for signatures, and saves building the push.
+ */
+void static FindAndDeletePush(CScript& scriptCode, const valtype& vch) {
+    if (scriptCode.size() > vch.size())
+        scriptCode.FindAndDelete(CScript(std::vector<unsigned char>(vch.begin(), vch.end())));
+}
+
 bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
     if (data.size() == 0) {
         // Could have used OP_0.
@@ -229,15 +249,37 @@ bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
     return true;
 }
 
-bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+/**
+ * The signature check of OP_CHECKSIG, with the script from pbegincodehash to
+ * pend as the script code. Returns false if the signature or public key
+ * encoding violates flags; otherwise fSuccess tells whether the signature
+ * is valid.
+ */
+bool static EvalChecksig(const valtype& vchSig, const valtype& vchPubKey, CScript::const_iterator pbegincodehash, CScript::const_iterator pend, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fSuccess)
+{
+    // Subset of script starting at the most recent codeseparator
+    CScript scriptCode(pbegincodehash, pend);
+
+    // Drop the signature, since there's no way for a signature to sign itself
+    FindAndDeletePush(scriptCode, vchSig);
+
+    if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
+        //serror is set
+        return false;
+    }
+    fSuccess = checker.CheckSig(vchSig, vchPubKey, scriptCode);
+    return true;
+}
+
+bool EvalScript(std::vector<valtype>& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
     static const CScriptNum bnFalse(0);
     static const CScriptNum bnTrue(1);
-    static const valtype vchFalse(0);
-    static const valtype vchZero(0);
-    static const valtype vchTrue(1, 1);
+    static const valtype vchFalse;
+    static const valtype vchZero;
+    static const valtype vchTrue(1, (unsigned char)1);
 
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
@@ -318,7 +360,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // ( -- value)
                     CScriptNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                     // The result of these opcodes should always be the minimal way to push the data
                     // they push, so no need for a CheckMinimalPush here.
                 }
@@ -561,8 +603,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 x4 -- x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-4), stacktop(-2));
-                    swap(stacktop(-3), stacktop(-1));
+                    stacktop(-4).swap(stacktop(-2));
+                    stacktop(-3).swap(stacktop(-1));
                 }
                 break;
 
@@ -581,7 +623,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // -- stacksize
                     CScriptNum bn(stack.size());
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                 }
                 break;
 
@@ -648,8 +690,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     //  x2 x3 x1  after second swap
                     if (stack.size() < 3)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-3), stacktop(-2));
-                    swap(stacktop(-2), stacktop(-1));
+                    stacktop(-3).swap(stacktop(-2));
+                    stacktop(-2).swap(stacktop(-1));
                 }
                 break;
 
@@ -658,7 +700,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-2), stacktop(-1));
+                    stacktop(-2).swap(stacktop(-1));
                 }
                 break;
 
@@ -679,7 +721,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     CScriptNum bn(stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                 }
                 break;
 
@@ -741,7 +783,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     default:            assert(!"invalid opcode"); break;
                     }
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                 }
                 break;
 
@@ -790,7 +832,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     }
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
@@ -832,7 +874,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32, (unsigned char)0);
                     if (opcode == OP_RIPEMD160)
                         CRIPEMD160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     else if (opcode == OP_SHA1)
@@ -865,17 +907,11 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     valtype& vchSig    = stacktop(-2);
                     valtype& vchPubKey = stacktop(-1);
 
-                    // Subset of script starting at the most recent codeseparator
-                    CScript scriptCode(pbegincodehash, pend);
-
-                    // Drop the signature, since there's no way for a signature to sign itself
-                    scriptCode.FindAndDelete(CScript(vchSig));
-
-                    if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
+                    bool fSuccess = false;
+                    if (!EvalChecksig(vchSig, vchPubKey, pbegincodehash, pend, flags, checker, serror, fSuccess)) {
                         //serror is set
                         return false;
                     }
-                    bool fSuccess = checker.CheckSig(vchSig, vchPubKey, scriptCode);
 
                     popstack(stack);
                     popstack(stack);
@@ -925,7 +961,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     for (int k = 0; k < nSigsCount; k++)
                     {
                         valtype& vchSig = stacktop(-isig-k);
-                        scriptCode.FindAndDelete(CScript(vchSig));
+                        FindAndDeletePush(scriptCode, vchSig);
                     }
 
                     bool fSuccess = true;
@@ -1007,6 +1043,22 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
     return set_success(serror);
 }
 
+bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    std::vector<valtype> stackItems;
+    stackItems.reserve(stack.size());
+    for (unsigned int i = 0; i < stack.size(); i++)
+        stackItems.push_back(valtype(stack[i].begin(), stack[i].end()));
+
+    bool fRet = EvalScript(stackItems, script, flags, checker, serror);
+
+    stack.clear();
+    stack.reserve(stackItems.size());
+    for (unsigned int i = 0; i < stackItems.size(); i++)
+        stack.push_back(std::vector<unsigned char>(stackItems[i].begin(), stackItems[i].end()));
+    return fRet;
+}
+
 namespace {
 
 /**
@@ -1104,9 +1156,95 @@ public:
     }
 };
 
+/** Stream that appends everything serialized to it to a byte vector */
+class CVectorWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+
+public:
+    const int nType;
+    const int nVersion;
+
+    CVectorWriter(int nTypeIn, int nVersionIn, std::vector<unsigned char>& vchIn) : vch(vchIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    CVectorWriter& write(const char *pch, size_t size) {
+        vch.insert(vch.end(), (const unsigned char*)pch, (const unsigned char*)pch + size);
+        return (*this);
+    }
+
+    template<typename T>
+    CVectorWriter& operator<<(const T& obj) {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+/** Like CHashWriter, but continuing from a precomputed SHA256 midstate */
+class CMidstateHashWriter
+{
+private:
+    CSHA256 ctx;
+
+public:
+    const int nType;
+    const int nVersion;
+
+    CMidstateHashWriter(int nTypeIn, int nVersionIn, const CSHA256& midstate) : ctx(midstate), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    CMidstateHashWriter& write(const char *pch, size_t size) {
+        ctx.Write((const unsigned char*)pch, size);
+        return (*this);
+    }
+
+    // invalidates the object
+    uint256 GetHash() {
+        unsigned char buf[CSHA256::OUTPUT_SIZE];
+        ctx.Finalize(buf);
+        uint256 result;
+        CSHA256().Write(buf, CSHA256::OUTPUT_SIZE).Finalize(result.begin());
+        return result;
+    }
+
+    template<typename T>
+    CMidstateHashWriter& operator<<(const T& obj) {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
+{
+    // Serialize like CTransactionSignatureSerializer does for SIGHASH_ALL,
+    // with the script of every input blanked
+    CVectorWriter s(SER_GETHASH, 0, vchBlanked);
+    s << txTo.nVersion;
+    ::WriteCompactSize(s, txTo.vin.size());
+    vInputOffsets.reserve(txTo.vin.size() + 1);
+    for (unsigned int i = 0; i < txTo.vin.size(); i++) {
+        vInputOffsets.push_back(vchBlanked.size());
+        s << txTo.vin[i].prevout << CScriptBase() << txTo.vin[i].nSequence;
+    }
+    vInputOffsets.push_back(vchBlanked.size());
+    ::WriteCompactSize(s, txTo.vout.size());
+    for (unsigned int i = 0; i < txTo.vout.size(); i++)
+        s << txTo.vout[i];
+    s << txTo.nLockTime;
+
+    // Hash the inputs once, remembering the state before each of them
+    CSHA256 ctx;
+    size_t nHashed = 0;
+    vMidstates.reserve(txTo.vin.size());
+    for (unsigned int i = 0; i < txTo.vin.size(); i++) {
+        ctx.Write(&vchBlanked[nHashed], vInputOffsets[i] - nHashed);
+        nHashed = vInputOffsets[i];
+        vMidstates.push_back(ctx);
+    }
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache)
 {
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
     if (nIn >= txTo.vin.size()) {
@@ -1125,6 +1263,21 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // Every hash type other than SINGLE and NONE without ANYONECANPAY
+    // serializes like SIGHASH_ALL: all inputs and outputs, with only the
+    // script of input nIn filled in. Resume from the state before that
+    // input, and append the part of the serialization after it.
+    if (cache && !(nHashType & SIGHASH_ANYONECANPAY) &&
+        (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        assert(cache->vMidstates.size() == txTo.vin.size());
+        CMidstateHashWriter ss(SER_GETHASH, 0, cache->vMidstates[nIn]);
+        txTmp.SerializeInput(ss, nIn, SER_GETHASH, 0);
+        size_t nSuffix = cache->vInputOffsets[nIn + 1];
+        ss.write((const char*)&cache->vchBlanked[nSuffix], cache->vchBlanked.size() - nSuffix);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1136,20 +1289,19 @@ bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned cha
     return pubkey.Verify(sighash, vchSig);
 }
 
-bool TransactionSignatureChecker::CheckSig(const std::vector<unsigned char>& vchSigIn, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
+bool TransactionSignatureChecker::CheckSig(const valtype& vchSigIn, const valtype& vchPubKey, const CScript& scriptCode) const
 {
-    CPubKey pubkey(vchPubKey);
+    CPubKey pubkey(vchPubKey.begin(), vchPubKey.end());
     if (!pubkey.IsValid())
         return false;
 
     // Hash type is one byte tacked on to the end of the signature
-    std::vector<unsigned char> vchSig(vchSigIn);
-    if (vchSig.empty())
+    if (vchSigIn.empty())
         return false;
-    int nHashType = vchSig.back();
-    vchSig.pop_back();
+    int nHashType = vchSigIn.back();
+    std::vector<unsigned char> vchSig(vchSigIn.begin(), vchSigIn.begin() + (vchSigIn.size() - 1));
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -1239,7 +1391,169 @@ bool TransactionSignatureChecker::CheckSequence(const CScriptNum& nSequence) con
     return true;
 }
 
+namespace {
+
+/**
+ * Parse a script that consists only of data pushes EvalScript accepts with
+ * these flags into stack, as EvalScript would leave it. Returns false for
+ * any other script, including ones EvalScript would reject.
+ */
+bool GetDataPushes(const CScript& script, unsigned int flags, std::vector<valtype>& stack)
+{
+    if (script.size() > 10000)
+        return false;
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    while (pc < script.end()) {
+        stack.push_back(valtype());
+        if (!script.GetOp(pc, opcode, stack.back()) || opcode > OP_PUSHDATA4)
+            return false;
+        if (stack.back().size() > MAX_SCRIPT_ELEMENT_SIZE)
+            return false;
+        if ((flags & SCRIPT_VERIFY_MINIMALDATA) && !CheckMinimalPush(stack.back(), opcode))
+            return false;
+    }
+    return true;
+}
+
+/** Match OP_m <pubkey>...<pubkey> OP_n OP_CHECKMULTISIG with 1 <= m <= n <= 16. */
+bool MatchMultisig(const CScript& script, int& nRequired, std::vector<valtype>& vKeys)
+{
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    valtype vch;
+    if (!script.GetOp(pc, opcode) || opcode < OP_1 || opcode > OP_16)
+        return false;
+    nRequired = CScript::DecodeOP_N(opcode);
+    while (script.GetOp(pc, opcode, vch) && opcode <= OP_PUSHDATA4) {
+        // Only direct pushes, which are always minimal
+        if ((unsigned int)opcode != vch.size() || (vch.size() != 33 && vch.size() != 65))
+            return false;
+        vKeys.push_back(vch);
+    }
+    if (opcode < OP_1 || opcode > OP_16 || CScript::DecodeOP_N(opcode) != (int)vKeys.size() || nRequired > (int)vKeys.size())
+        return false;
+    return script.GetOp(pc, opcode) && opcode == OP_CHECKMULTISIG && pc == script.end();
+}
+
+/**
+ * OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG spent by a scriptSig of
+ * exactly two data pushes.
+ */
+bool VerifyPayToPubKeyHash(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fResult)
+{
+    std::vector<valtype> stack;
+    stack.reserve(2);
+    if (!GetDataPushes(scriptSig, flags, stack) || stack.size() != 2)
+        return false;
+    const valtype& vchSig = stack[0];
+    const valtype& vchPubKey = stack[1];
+
+    uint160 hash;
+    CHash160().Write(vchPubKey.data(), vchPubKey.size()).Finalize(hash.begin());
+    if (memcmp(hash.begin(), &scriptPubKey[3], 20) != 0) {
+        fResult = set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+        return true;
+    }
+
+    // OP_CHECKSIG sees the whole scriptPubKey, which has no codeseparator
+    bool fSuccess = false;
+    if (!EvalChecksig(vchSig, vchPubKey, scriptPubKey.begin(), scriptPubKey.end(), flags, checker, serror, fSuccess)) {
+        fResult = false;
+        return true;
+    }
+    fResult = fSuccess ? set_success(serror) : set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+    return true;
+}
+
+/**
+ * OP_HASH160 <hash> OP_EQUAL spent by a scriptSig of data pushes: a dummy,
+ * exactly m signatures and a redeem script matching MatchMultisig whose hash
+ * is <hash>.
+ */
+bool VerifyPayToScriptHashMultisig(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fResult)
+{
+    std::vector<valtype> stack;
+    stack.reserve(SCRIPT_STACK_RESERVE);
+    if (!GetDataPushes(scriptSig, flags, stack) || stack.size() < 3)
+        return false;
+    const valtype& vchRedeemScript = stack.back();
+
+    uint160 hash;
+    CHash160().Write(vchRedeemScript.data(), vchRedeemScript.size()).Finalize(hash.begin());
+    if (memcmp(hash.begin(), &scriptPubKey[2], 20) != 0)
+        return false;
+
+    CScript redeemScript(vchRedeemScript.data(), vchRedeemScript.data() + vchRedeemScript.size());
+    int nSigsCount;
+    std::vector<valtype> vKeys;
+    if (!MatchMultisig(redeemScript, nSigsCount, vKeys) || (int)stack.size() != nSigsCount + 2)
+        return false;
+
+    // From here on this is OP_CHECKMULTISIG: drop the signatures from the
+    // script code, then match signatures to keys, both starting with the
+    // one closest to the top of the stack.
+    CScript scriptCode(redeemScript);
+    for (int k = 0; k < nSigsCount; k++)
+        FindAndDeletePush(scriptCode, stack[nSigsCount - k]);
+
+    int isig = nSigsCount;
+    int ikey = vKeys.size() - 1;
+    int nKeysCount = vKeys.size();
+    bool fSuccess = true;
+    while (fSuccess && nSigsCount > 0)
+    {
+        const valtype& vchSig = stack[isig];
+        const valtype& vchPubKey = vKeys[ikey];
+
+        if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
+            fResult = false;
+            return true;
+        }
+
+        if (checker.CheckSig(vchSig, vchPubKey, scriptCode)) {
+            isig--;
+            nSigsCount--;
+        }
+        ikey--;
+        nKeysCount--;
+
+        if (nSigsCount > nKeysCount)
+            fSuccess = false;
+    }
+
+    if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stack[0].size()) {
+        fResult = set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
+        return true;
+    }
+    fResult = fSuccess ? set_success(serror) : set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+    return true;
+}
+
+} // anon namespace
+
+bool VerifyScriptTemplate(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fResult)
+{
+    try {
+        if (scriptPubKey.IsPayToPublicKeyHash())
+            return VerifyPayToPubKeyHash(scriptSig, scriptPubKey, flags, checker, serror, fResult);
+        if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash())
+            return VerifyPayToScriptHashMultisig(scriptSig, scriptPubKey, flags, checker, serror, fResult);
+    } catch (...) {
+        // Leave anything unexpected to the generic path
+    }
+    return false;
+}
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    bool fResult;
+    if (VerifyScriptTemplate(scriptSig, scriptPubKey, flags, checker, serror, fResult))
+        return fResult;
+    return VerifyScriptGeneric(scriptSig, scriptPubKey, flags, checker, serror);
+}
+
+bool VerifyScriptGeneric(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
 
@@ -1247,11 +1561,14 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
-    std::vector<std::vector<unsigned char> > stack, stackCopy;
+    std::vector<valtype> stack, stackCopy;
+    stack.reserve(SCRIPT_STACK_RESERVE);
     if (!EvalScript(stack, scriptSig, flags, checker, serror))
         // serror is set
         return false;
-    if (flags & SCRIPT_VERIFY_P2SH)
+    // Only a P2SH spend needs the stack as the scriptSig left it
+    bool fP2SH = (flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash();
+    if (fP2SH)
         stackCopy = stack;
     if (!EvalScript(stack, scriptPubKey, flags, checker, serror))
         // serror is set
@@ -1262,7 +1579,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
 
     // Additional validation for spend-to-script-hash transactions:
-    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash())
+    if (fP2SH)
     {
         // scriptSig must be literals-only or validation fails
         if (!scriptSig.IsPushOnly())
@@ -1277,7 +1594,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         assert(!stack.empty());
 
         const valtype& pubKeySerialized = stack.back();
-        CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
+        CScript pubKey2(pubKeySerialized.data(), pubKeySerialized.data() + pubKeySerialized.size());
         popstack(stack);
 
         if (!EvalScript(stack, pubKey2, flags, checker, serror))
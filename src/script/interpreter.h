@@ -7,6 +7,7 @@
 #define CREDITS_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "crypto/sha256.h"
 #include "primitives/transaction.h"
 
 #include <vector>
@@ -89,13 +90,31 @@ enum
 };
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
+bool CheckSignatureEncoding(const CScriptStackItem &vchSig, unsigned int flags, ScriptError* serror);
+
+/**
+ * Data shared by the signature checks of all inputs of one transaction, so
+ * that SIGHASH_ALL signature hashes don't reserialize and rehash the whole
+ * transaction for every input. vchBlanked is the serialization SignatureHash
+ * uses with every input script blanked, vInputOffsets[i] is where input i
+ * starts in it (the last entry is where the outputs start), and
+ * vMidstates[i] is the SHA256 state after hashing everything before input i.
+ */
+struct PrecomputedTransactionData
+{
+    std::vector<unsigned char> vchBlanked;
+    std::vector<size_t> vInputOffsets;
+    std::vector<CSHA256> vMidstates;
+
+    explicit PrecomputedTransactionData(const CTransaction& tx);
+};
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache = NULL);
 
 class BaseSignatureChecker
 {
 public:
-    virtual bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
+    virtual bool CheckSig(const CScriptStackItem& scriptSig, const CScriptStackItem& vchPubKey, const CScript& scriptCode) const
     {
         return false;
     }
@@ -118,13 +137,14 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
-    bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
+    bool CheckSig(const CScriptStackItem& scriptSig, const CScriptStackItem& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
     bool CheckSequence(const CScriptNum& nSequence) const;
 };
@@ -138,7 +158,20 @@ public:
     MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn) : TransactionSignatureChecker(&txTo, nInIn), txTo(*txToIn) {}
 };
 
+bool EvalScript(std::vector<CScriptStackItem>& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
+/** Same as above, converting the stack from and to byte vectors */
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror = NULL);
 
+/**
+ * Verify a spend of one of the common standard templates, P2PKH or P2SH of a
+ * bare m-of-n CHECKMULTISIG, without running the opcode loop. Returns false
+ * if the spend is not handled this way; otherwise fResult and serror are set
+ * to exactly what VerifyScriptGeneric would produce. Used by VerifyScript.
+ */
+bool VerifyScriptTemplate(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fResult);
+
+/** VerifyScript without the VerifyScriptTemplate shortcut */
+bool VerifyScriptGeneric(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror = NULL);
+
 #endif // CREDITS_SCRIPT_INTERPRETER_H
@@ -217,7 +217,8 @@ public:
 
     static const size_t nDefaultMaxNumSize = 4;
 
-    explicit CScriptNum(const std::vector<unsigned char>& vch, bool fRequireMinimal,
+    template<typename T>
+    explicit CScriptNum(const T& vch, bool fRequireMinimal,
                         const size_t nMaxNumSize = nDefaultMaxNumSize)
     {
         if (vch.size() > nMaxNumSize) {
@@ -314,17 +315,19 @@ public:
         return m_value;
     }
 
-    std::vector<unsigned char> getvch() const
+    template<typename T = std::vector<unsigned char> >
+    T getvch() const
     {
-        return serialize(m_value);
+        return serialize<T>(m_value);
     }
 
-    static std::vector<unsigned char> serialize(const int64_t& value)
+    template<typename T = std::vector<unsigned char> >
+    static T serialize(const int64_t& value)
     {
         if(value == 0)
-            return std::vector<unsigned char>();
+            return T();
 
-        std::vector<unsigned char> result;
+        T result;
         const bool neg = value < 0;
         uint64_t absvalue = neg ? -value : value;
 
@@ -353,7 +356,8 @@ public:
     }
 
 private:
-    static int64_t set_vch(const std::vector<unsigned char>& vch)
+    template<typename T>
+    static int64_t set_vch(const T& vch)
     {
       if (vch.empty())
           return 0;
@@ -375,6 +379,13 @@ private:
 
 typedef prevector<28, unsigned char> CScriptBase;
 
+/**
+ * Element of the script interpreter's stack. Anything a direct push can put
+ * there (up to 75 bytes, which includes signatures and public keys) is
+ * stored inline, without a heap allocation.
+ */
+typedef prevector<75, unsigned char> CScriptStackItem;
+
 /** Serialized script, used inside transaction inputs and outputs */
 class CScript : public CScriptBase
 {
@@ -503,7 +514,18 @@ public:
         return GetOp2(pc, opcodeRet, NULL);
     }
 
+    bool GetOp(const_iterator& pc, opcodetype& opcodeRet, CScriptStackItem& vchRet) const
+    {
+        return GetScriptOp(pc, opcodeRet, &vchRet);
+    }
+
     bool GetOp2(const_iterator& pc, opcodetype& opcodeRet, std::vector<unsigned char>* pvchRet) const
+    {
+        return GetScriptOp(pc, opcodeRet, pvchRet);
+    }
+
+    template<typename T>
+    bool GetScriptOp(const_iterator& pc, opcodetype& opcodeRet, T* pvchRet) const
     {
         opcodeRet = OP_INVALIDOPCODE;
         if (pvchRet)
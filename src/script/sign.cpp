@@ -12,11 +12,14 @@
 #include "primitives/transaction.h"
 #include "uint256.h"
 
+#include <atomic>
+
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 
 typedef std::vector<unsigned char> valtype;
 
-TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, int nHashTypeIn) : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), checker(txTo, nIn) {}
+TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, int nHashTypeIn, const PrecomputedTransactionData* txdataIn) : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), checker(txTo, nIn, txdataIn), txdata(txdataIn) {}
 
 bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& address, const CScript& scriptCode) const
 {
@@ -24,7 +27,7 @@ bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig,
     if (!keystore->GetKey(address, key))
         return false;
 
-    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
     if (!key.Sign(hash, vchSig))
         return false;
     vchSig.push_back((unsigned char)nHashType);
@@ -172,6 +175,121 @@ bool SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CMutab
     return SignSignature(keystore, txout.scriptPubKey, txTo, nIn, nHashType);
 }
 
+namespace {
+
+/** Inputs each signing thread should get at least; below that, threads cost more than they save. */
+static const unsigned int MIN_INPUTS_PER_SIGNING_THREAD = 16;
+
+/** A DummySignatureCreator that records which keys it is asked to sign with. */
+class KeyRecordingSignatureCreator : public DummySignatureCreator {
+    std::set<CKeyID>& setKeyIDs;
+
+public:
+    KeyRecordingSignatureCreator(const CKeyStore* keystoreIn, std::set<CKeyID>& setKeyIDsIn) : DummySignatureCreator(keystoreIn), setKeyIDs(setKeyIDsIn) {}
+
+    bool CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode) const
+    {
+        setKeyIDs.insert(keyid);
+        // Fail like the real signer would, so multisig asks for the next key
+        if (!keystore->HaveKey(keyid))
+            return false;
+        return DummySignatureCreator::CreateSig(vchSig, keyid, scriptCode);
+    }
+};
+
+/**
+ * Signs inputs of one transaction for SignSignatures, taking the next
+ * unsigned input until none are left. Run on several threads at once.
+ */
+class CInputSigner
+{
+private:
+    const CKeyStore& keystore;
+    const CTransaction& txTo;
+    const PrecomputedTransactionData& txdata;
+    const std::vector<std::pair<unsigned int, CScript> >& vInputs;
+    int nHashType;
+    std::atomic<size_t> nNext;
+
+public:
+    std::vector<CScript> vScriptSigs;
+    std::vector<char> vSigned;
+
+    CInputSigner(const CKeyStore& keystoreIn, const CTransaction& txToIn, const PrecomputedTransactionData& txdataIn, const std::vector<std::pair<unsigned int, CScript> >& vInputsIn, int nHashTypeIn) :
+        keystore(keystoreIn), txTo(txToIn), txdata(txdataIn), vInputs(vInputsIn), nHashType(nHashTypeIn), nNext(0),
+        vScriptSigs(vInputsIn.size()), vSigned(vInputsIn.size(), false) {}
+
+    void operator()()
+    {
+        for (size_t i = nNext++; i < vInputs.size(); i = nNext++) {
+            TransactionSignatureCreator creator(&keystore, &txTo, vInputs[i].first, nHashType, &txdata);
+            vSigned[i] = ProduceSignature(creator, vInputs[i].second, vScriptSigs[i]);
+        }
+    }
+};
+
+} // anon namespace
+
+bool SignSignatures(const CKeyStore& keystore, CMutableTransaction& txTo, const std::vector<std::pair<unsigned int, CScript> >& vInputs, int nHashType, unsigned int nThreads)
+{
+    nThreads = std::min(nThreads, (unsigned int)(vInputs.size() / MIN_INPUTS_PER_SIGNING_THREAD));
+
+    const CTransaction txToConst(txTo);
+    const PrecomputedTransactionData txdata(txToConst);
+
+    if (nThreads <= 1) {
+        bool fSigned = true;
+        for (unsigned int i = 0; i < vInputs.size(); i++) {
+            assert(vInputs[i].first < txTo.vin.size());
+            TransactionSignatureCreator creator(&keystore, &txToConst, vInputs[i].first, nHashType, &txdata);
+            if (!ProduceSignature(creator, vInputs[i].second, txTo.vin[vInputs[i].first].scriptSig))
+                fSigned = false;
+        }
+        return fSigned;
+    }
+
+    // Find out which keys and redeem scripts the inputs need, and copy them
+    // into a private keystore the signing threads can share. Each key is
+    // fetched once, however many inputs spend to it.
+    std::set<CKeyID> setKeyIDs;
+    CBasicKeyStore keystoreInputs;
+    for (unsigned int i = 0; i < vInputs.size(); i++) {
+        assert(vInputs[i].first < txTo.vin.size());
+        CScript scriptSigDummy;
+        ProduceSignature(KeyRecordingSignatureCreator(&keystore, setKeyIDs), vInputs[i].second, scriptSigDummy);
+
+        CTxDestination dest;
+        CScript redeemScript;
+        if (vInputs[i].second.IsPayToScriptHash() && ExtractDestination(vInputs[i].second, dest) &&
+            keystore.GetCScript(boost::get<CScriptID>(dest), redeemScript))
+            keystoreInputs.AddCScript(redeemScript);
+    }
+    BOOST_FOREACH(const CKeyID& keyid, setKeyIDs) {
+        CKey key;
+        CPubKey pubkey;
+        if (!keystore.GetKey(keyid, key))
+            continue;
+        if (!keystore.GetPubKey(keyid, pubkey))
+            pubkey = key.GetPubKey();
+        keystoreInputs.AddKeyPubKey(key, pubkey);
+    }
+
+    CInputSigner signer(keystoreInputs, txToConst, txdata, vInputs, nHashType);
+    boost::thread_group threadGroup;
+    for (unsigned int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(boost::ref(signer));
+    signer();
+    threadGroup.join_all();
+
+    bool fSigned = true;
+    for (unsigned int i = 0; i < vInputs.size(); i++) {
+        txTo.vin[vInputs[i].first].scriptSig = signer.vScriptSigs[i];
+        if (!signer.vSigned[i])
+            fSigned = false;
+    }
+    return fSigned;
+}
+
 static CScript PushAll(const std::vector<valtype>& values)
 {
     CScript result;
@@ -210,7 +328,7 @@ static CScript CombineMultisig(const CScript& scriptPubKey, const BaseSignatureC
             if (sigs.count(pubkey))
                 continue; // Already got a sig for this pubkey
 
-            if (checker.CheckSig(sig, pubkey, scriptPubKey))
+            if (checker.CheckSig(CScriptStackItem(sig.begin(), sig.end()), CScriptStackItem(pubkey.begin(), pubkey.end()), scriptPubKey))
             {
                 sigs[pubkey] = sig;
                 break;
@@ -309,7 +427,7 @@ class DummySignatureChecker : public BaseSignatureChecker
 public:
     DummySignatureChecker() {}
 
-    bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
+    bool CheckSig(const CScriptStackItem& scriptSig, const CScriptStackItem& vchPubKey, const CScript& scriptCode) const
     {
         return true;
     }
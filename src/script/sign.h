@@ -37,9 +37,10 @@ class TransactionSignatureCreator : public BaseSignatureCreator {
     unsigned int nIn;
     int nHashType;
     const TransactionSignatureChecker checker;
+    const PrecomputedTransactionData* txdata;
 
 public:
-    TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, int nHashTypeIn=SIGHASH_ALL);
+    TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, int nHashTypeIn=SIGHASH_ALL, const PrecomputedTransactionData* txdataIn=NULL);
     const BaseSignatureChecker& Checker() const { return checker; }
     bool CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode) const;
 };
@@ -59,6 +60,16 @@ bool ProduceSignature(const BaseSignatureCreator& creator, const CScript& script
 bool SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CMutableTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
 bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
 
+/**
+ * Produce script signatures for several inputs of a transaction, spread over
+ * up to nThreads threads. vInputs pairs the index of each input to sign with
+ * the script it spends. The keys are fetched from keystore on the calling
+ * thread first, so keystore is never used concurrently and any locks its
+ * owner holds stay valid. The result is the same as calling SignSignature
+ * for each input in turn. Returns false if any input could not be signed.
+ */
+bool SignSignatures(const CKeyStore& keystore, CMutableTransaction& txTo, const std::vector<std::pair<unsigned int, CScript> >& vInputs, int nHashType, unsigned int nThreads);
+
 /** Combine two script signatures using a generic signature checker, intelligently, possibly with OP_0 placeholders. */
 CScript CombineSignatures(const CScript& scriptPubKey, const BaseSignatureChecker& checker, const CScript& scriptSig1, const CScript& scriptSig2);
 
@@ -0,0 +1,339 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "script/script.h"
+#include "random.h"
+#include "txdb.h"
+#include "uint256.h"
+#include "util.h"
+
+#include "test/test_credits.h"
+#include "test/test_random.h"
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+/** Points the data directory at a scratch location so that an in-memory
+ *  CBlockTreeDB can be opened without loading a chain. */
+struct AddressIndexTestingSetup : public BasicTestingSetup {
+    boost::filesystem::path pathTemp;
+
+    AddressIndexTestingSetup()
+    {
+        ClearDatadirCache();
+        pathTemp = GetTempPath() / strprintf("test_credits_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+    }
+
+    ~AddressIndexTestingSetup()
+    {
+        ClearDatadirCache();
+        boost::filesystem::remove_all(pathTemp);
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, AddressIndexTestingSetup)
+
+static bool HeightTxIndexLess(const std::pair<CAddressIndexKey, CAmount>& a,
+                              const std::pair<CAddressIndexKey, CAmount>& b)
+{
+    if (a.first.blockHeight != b.first.blockHeight)
+        return a.first.blockHeight < b.first.blockHeight;
+    return a.first.txindex < b.first.txindex;
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_merge)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    std::vector<std::pair<uint160, int> > addresses;
+    for (int i = 0; i < 4; i++) {
+        uint160 hash;
+        GetRandBytes(hash.begin(), hash.size());
+        addresses.push_back(std::make_pair(hash, 1 + i % 2));
+    }
+
+    // Each address gets outputs in random blocks; some transactions touch
+    // several addresses and pay the same address more than once.
+    std::vector<std::pair<CAddressIndexKey, CAmount> > entries;
+    for (int height = 1; height <= 50; height++) {
+        for (unsigned int txindex = 0; txindex < 4; txindex++) {
+            uint256 txid = GetRandHash();
+            for (size_t a = 0; a < addresses.size(); a++) {
+                if (insecure_rand() % 3 != 0)
+                    continue;
+                int nOutputs = 1 + insecure_rand() % 2;
+                for (int n = 0; n < nOutputs; n++) {
+                    CAddressIndexKey key(addresses[a].second, addresses[a].first, height, txindex, txid, n, false);
+                    entries.push_back(std::make_pair(key, (CAmount)(height * 100 + n)));
+                }
+            }
+        }
+    }
+    BOOST_CHECK(db.WriteAddressIndex(entries));
+
+    // The merged read returns the same entries as the per-address reads, in
+    // (height, txindex) order.
+    std::vector<std::pair<CAddressIndexKey, CAmount> > expected;
+    for (size_t a = 0; a < addresses.size(); a++) {
+        BOOST_CHECK(db.ReadAddressIndex(addresses[a].first, addresses[a].second, expected));
+    }
+    std::stable_sort(expected.begin(), expected.end(), HeightTxIndexLess);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > merged;
+    BOOST_CHECK(db.ReadAddressIndex(addresses, merged));
+    BOOST_CHECK_EQUAL(merged.size(), entries.size());
+    BOOST_CHECK_EQUAL(merged.size(), expected.size());
+    for (size_t i = 0; i < merged.size() && i < expected.size(); i++) {
+        BOOST_CHECK_EQUAL(merged[i].first.blockHeight, expected[i].first.blockHeight);
+        BOOST_CHECK_EQUAL(merged[i].first.txindex, expected[i].first.txindex);
+        BOOST_CHECK(merged[i].first.txhash == expected[i].first.txhash);
+        BOOST_CHECK_EQUAL(merged[i].second, expected[i].second);
+    }
+
+    // A height range only returns entries within it.
+    std::vector<std::pair<CAddressIndexKey, CAmount> > range;
+    BOOST_CHECK(db.ReadAddressIndex(addresses, range, 10, 20));
+    BOOST_CHECK(!range.empty());
+    for (size_t i = 0; i < range.size(); i++) {
+        BOOST_CHECK(range[i].first.blockHeight >= 10 && range[i].first.blockHeight <= 20);
+    }
+
+    // A limit counts distinct transactions and never splits one.
+    std::vector<std::pair<CAddressIndexKey, CAmount> > limited;
+    BOOST_CHECK(db.ReadAddressIndex(addresses, limited, 0, 0, 5));
+    size_t nTxs = 0;
+    for (size_t i = 0; i < limited.size(); i++) {
+        if (i == 0 || limited[i].first.txhash != limited[i - 1].first.txhash)
+            nTxs++;
+        BOOST_CHECK(limited[i].first.txhash == merged[i].first.txhash);
+    }
+    BOOST_CHECK_EQUAL(nTxs, 5U);
+    BOOST_CHECK(limited.size() == merged.size() || limited.back().first.txhash != merged[limited.size()].first.txhash);
+}
+
+static bool AddressUnspentLess(const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a,
+                               const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b)
+{
+    if (a.first.txhash != b.first.txhash)
+        return a.first.txhash < b.first.txhash;
+    return a.first.index < b.first.index;
+}
+
+static void CheckAddressIndexEqual(const std::vector<std::pair<CAddressIndexKey, CAmount> >& a,
+                                   const std::vector<std::pair<CAddressIndexKey, CAmount> >& b)
+{
+    BOOST_CHECK_EQUAL(a.size(), b.size());
+    for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+        BOOST_CHECK_EQUAL(a[i].first.type, b[i].first.type);
+        BOOST_CHECK(a[i].first.hashBytes == b[i].first.hashBytes);
+        BOOST_CHECK_EQUAL(a[i].first.blockHeight, b[i].first.blockHeight);
+        BOOST_CHECK_EQUAL(a[i].first.txindex, b[i].first.txindex);
+        BOOST_CHECK(a[i].first.txhash == b[i].first.txhash);
+        BOOST_CHECK_EQUAL(a[i].first.index, b[i].first.index);
+        BOOST_CHECK_EQUAL(a[i].first.spending, b[i].first.spending);
+        BOOST_CHECK_EQUAL(a[i].second, b[i].second);
+    }
+}
+
+static void CheckAddressIndexEquivalent(CBlockTreeDB& a, CBlockTreeDB& b, const std::vector<std::pair<uint160, int> >& addresses)
+{
+    for (size_t i = 0; i < addresses.size(); i++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > indexA, indexB;
+        BOOST_CHECK(a.ReadAddressIndex(addresses[i].first, addresses[i].second, indexA));
+        BOOST_CHECK(b.ReadAddressIndex(addresses[i].first, addresses[i].second, indexB));
+        CheckAddressIndexEqual(indexA, indexB);
+
+        indexA.clear();
+        indexB.clear();
+        BOOST_CHECK(a.ReadAddressIndex(addresses[i].first, addresses[i].second, indexA, 5, 15));
+        BOOST_CHECK(b.ReadAddressIndex(addresses[i].first, addresses[i].second, indexB, 5, 15));
+        CheckAddressIndexEqual(indexA, indexB);
+
+        // Unspent outputs are ordered by txid in one format and by tx
+        // number in the other, so compare them as sets.
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentA, unspentB;
+        BOOST_CHECK(a.ReadAddressUnspentIndex(addresses[i].first, addresses[i].second, unspentA));
+        BOOST_CHECK(b.ReadAddressUnspentIndex(addresses[i].first, addresses[i].second, unspentB));
+        std::sort(unspentA.begin(), unspentA.end(), AddressUnspentLess);
+        std::sort(unspentB.begin(), unspentB.end(), AddressUnspentLess);
+        BOOST_CHECK_EQUAL(unspentA.size(), unspentB.size());
+        for (size_t j = 0; j < unspentA.size() && j < unspentB.size(); j++) {
+            BOOST_CHECK(unspentA[j].first.txhash == unspentB[j].first.txhash);
+            BOOST_CHECK_EQUAL(unspentA[j].first.index, unspentB[j].first.index);
+            BOOST_CHECK_EQUAL(unspentA[j].second.satoshis, unspentB[j].second.satoshis);
+            BOOST_CHECK(unspentA[j].second.script == unspentB[j].second.script);
+            BOOST_CHECK_EQUAL(unspentA[j].second.blockHeight, unspentB[j].second.blockHeight);
+        }
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > mergedA, mergedB;
+    BOOST_CHECK(a.ReadAddressIndex(addresses, mergedA, 0, 0, 7));
+    BOOST_CHECK(b.ReadAddressIndex(addresses, mergedB, 0, 0, 7));
+    CheckAddressIndexEqual(mergedA, mergedB);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_compact)
+{
+    CBlockTreeDB legacy(1 << 20, true);
+    CBlockTreeDB compact(1 << 20, true);
+    compact.SetCompactAddressIndex(true);
+
+    std::vector<std::pair<uint160, int> > addresses;
+    for (int i = 0; i < 3; i++) {
+        uint160 hash;
+        GetRandBytes(hash.begin(), hash.size());
+        addresses.push_back(std::make_pair(hash, 1 + i % 2));
+    }
+
+    // Connect blocks the way ConnectBlock does: address index entries
+    // first, then the unspent index updates. Spends have negative amounts.
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspents;
+    for (int height = 1; height <= 30; height++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > entries;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > updates;
+        for (unsigned int txindex = 0; txindex < 300; txindex += 1 + insecure_rand() % 100) {
+            uint256 txid = GetRandHash();
+            for (unsigned int n = 0; n < 3; n++) {
+                const std::pair<uint160, int>& address = addresses[insecure_rand() % addresses.size()];
+                if (!unspents.empty() && insecure_rand() % 4 == 0) {
+                    size_t pos = insecure_rand() % unspents.size();
+                    const CAddressUnspentKey& spent = unspents[pos].first;
+                    entries.push_back(std::make_pair(CAddressIndexKey(spent.type, spent.hashBytes, height, txindex, txid, n, true),
+                                                     -unspents[pos].second.satoshis));
+                    updates.push_back(std::make_pair(spent, CAddressUnspentValue()));
+                    unspents.erase(unspents.begin() + pos);
+                }
+                CAmount amount = 1 + insecure_rand() % 100000000;
+                CScript script = CScript() << OP_DUP << OP_HASH160 << ToByteVector(address.first) << OP_EQUALVERIFY << OP_CHECKSIG;
+                CAddressUnspentKey key(address.second, address.first, txid, n + 3);
+                entries.push_back(std::make_pair(CAddressIndexKey(address.second, address.first, height, txindex, txid, n + 3, false), amount));
+                updates.push_back(std::make_pair(key, CAddressUnspentValue(amount, script, height)));
+                unspents.push_back(updates.back());
+            }
+        }
+        BOOST_CHECK(legacy.WriteAddressIndex(entries));
+        BOOST_CHECK(legacy.UpdateAddressUnspentIndex(updates));
+        BOOST_CHECK(compact.WriteAddressIndex(entries));
+        BOOST_CHECK(compact.UpdateAddressUnspentIndex(updates));
+    }
+    CheckAddressIndexEquivalent(legacy, compact, addresses);
+
+    // Migrating in either direction preserves every query result.
+    BOOST_CHECK(legacy.ConvertAddressIndex(true));
+    BOOST_CHECK(legacy.IsCompactAddressIndex());
+    CheckAddressIndexEquivalent(legacy, compact, addresses);
+
+    BOOST_CHECK(compact.ConvertAddressIndex(false));
+    BOOST_CHECK(!compact.IsCompactAddressIndex());
+    CheckAddressIndexEquivalent(legacy, compact, addresses);
+
+    bool fCompact = false;
+    BOOST_CHECK(legacy.ReadFlag("compactaddressindex", fCompact) && fCompact);
+    BOOST_CHECK(compact.ReadFlag("compactaddressindex", fCompact) && !fCompact);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_compact_disconnect)
+{
+    CBlockTreeDB db(1 << 20, true);
+    db.SetCompactAddressIndex(true);
+
+    uint160 hash;
+    GetRandBytes(hash.begin(), hash.size());
+    CScript script = CScript() << OP_DUP << OP_HASH160 << ToByteVector(hash) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    // Connect a transaction at height 10, then disconnect it the way
+    // DisconnectBlock does.
+    uint256 txid = GetRandHash();
+    std::vector<std::pair<CAddressIndexKey, CAmount> > entries(1, std::make_pair(CAddressIndexKey(1, hash, 10, 1, txid, 0, false), 5000));
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > updates(1, std::make_pair(CAddressUnspentKey(1, hash, txid, 0), CAddressUnspentValue(5000, script, 10)));
+    BOOST_CHECK(db.WriteAddressIndex(entries));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(updates));
+
+    updates[0].second.SetNull();
+    BOOST_CHECK(db.EraseAddressIndex(entries));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(updates));
+    BOOST_CHECK(db.EraseAddressTxNumbers(entries));
+
+    // The tx number is gone with the transaction's entries
+    BOOST_CHECK(!db.UpdateAddressUnspentIndex(updates));
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    BOOST_CHECK(db.ReadAddressIndex(hash, 1, addressIndex));
+    BOOST_CHECK(addressIndex.empty());
+
+    // A different transaction connected at the same position resolves to
+    // its own txid
+    uint256 txidOther = GetRandHash();
+    entries[0].first.txhash = txidOther;
+    BOOST_CHECK(db.WriteAddressIndex(entries));
+    BOOST_CHECK(db.ReadAddressIndex(hash, 1, addressIndex));
+    BOOST_CHECK_EQUAL(addressIndex.size(), 1U);
+    BOOST_CHECK(addressIndex[0].first.txhash == txidOther);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_paging)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    uint160 hash;
+    GetRandBytes(hash.begin(), hash.size());
+    std::vector<std::pair<uint160, int> > addresses(1, std::make_pair(hash, 1));
+
+    // Two transactions at each of heights 1 to 20, one of them with two outputs
+    std::vector<std::pair<CAddressIndexKey, CAmount> > entries;
+    for (int height = 1; height <= 20; height++) {
+        for (unsigned int txindex = 1; txindex <= 2; txindex++) {
+            uint256 txid = GetRandHash();
+            for (unsigned int n = 0; n < txindex; n++)
+                entries.push_back(std::make_pair(CAddressIndexKey(1, hash, height, txindex, txid, n, false), (CAmount)(height * 100 + n)));
+        }
+    }
+    BOOST_CHECK(db.WriteAddressIndex(entries));
+    std::vector<std::pair<CAddressIndexKey, CAmount> > all;
+    BOOST_CHECK(db.ReadAddressIndex(addresses, all));
+    BOOST_CHECK_EQUAL(all.size(), entries.size());
+
+    // A page read past the limit of 5 transactions ends with a complete
+    // height and says where the next one starts
+    const unsigned int nMaxTxs = 5;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > page;
+    int nNextHeight;
+    BOOST_CHECK(db.ReadAddressIndex(addresses, page, 0, 0, nMaxTxs + 1));
+    BOOST_CHECK(TrimAddressIndexPage(page, nMaxTxs, nNextHeight));
+    BOOST_REQUIRE(!page.empty());
+    BOOST_CHECK_EQUAL(page.back().first.blockHeight, 2);
+    BOOST_CHECK_EQUAL(nNextHeight, page.back().first.blockHeight + 1);
+
+    // Following the marker returns every entry exactly once
+    std::vector<std::pair<CAddressIndexKey, CAmount> > paged(page);
+    int nPages = 1;
+    while (nNextHeight > 0) {
+        page.clear();
+        BOOST_CHECK(db.ReadAddressIndex(addresses, page, nNextHeight, 20, nMaxTxs + 1));
+        BOOST_REQUIRE(!page.empty());
+        BOOST_CHECK_EQUAL(page.front().first.blockHeight, nNextHeight);
+        BOOST_CHECK(TrimAddressIndexPage(page, nMaxTxs, nNextHeight));
+        paged.insert(paged.end(), page.begin(), page.end());
+        nPages++;
+    }
+    BOOST_CHECK_EQUAL(nPages, 10);
+    BOOST_CHECK_EQUAL(paged.size(), all.size());
+    for (size_t i = 0; i < paged.size() && i < all.size(); i++)
+        BOOST_CHECK(paged[i].first.txhash == all[i].first.txhash && paged[i].first.index == all[i].first.index);
+
+    // A complete read gets no marker; a height over the limit can't be paged
+    page = all;
+    BOOST_CHECK(TrimAddressIndexPage(page, 1000, nNextHeight));
+    BOOST_CHECK_EQUAL(nNextHeight, 0);
+    BOOST_CHECK_EQUAL(page.size(), all.size());
+    page.clear();
+    BOOST_CHECK(db.ReadAddressIndex(addresses, page, 0, 0, 2));
+    BOOST_CHECK(!TrimAddressIndexPage(page, 1, nNextHeight));
+    BOOST_CHECK_EQUAL(nNextHeight, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "base58.h"
+#include "hdchain.h"
 #include "key.h"
 #include "uint256.h"
 #include "util.h"
@@ -146,4 +147,24 @@ BOOST_AUTO_TEST_CASE(bip32_test2) {
     RunTest(test2);
 }
 
+BOOST_AUTO_TEST_CASE(bip32_hdchain_batch) {
+    // Batched public derivation must give the same keys as deriving each
+    // private key on its own
+    std::vector<unsigned char> seed = ParseHex(test1.strHexMaster);
+    CHDChain chain;
+    chain.SetSeed(SecureVector(seed.begin(), seed.end()), true);
+
+    for (int i = 0; i < 2; i++) {
+        bool fInternal = i == 1;
+        std::vector<CExtPubKey> vExtPubKeys;
+        chain.DeriveChildExtPubKeys(0, fInternal, 5, 300, vExtPubKeys, 4);
+        BOOST_CHECK_EQUAL(vExtPubKeys.size(), 300U);
+        for (unsigned int j = 0; j < vExtPubKeys.size(); j++) {
+            CExtKey extKey;
+            chain.DeriveChildExtKey(0, fInternal, 5 + j, extKey);
+            BOOST_CHECK(extKey.Neuter() == vExtPubKeys[j]);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,137 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "arith_uint256.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "test/test_credits.h"
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+static GCSFilter::Element MakeElement(unsigned int n)
+{
+    uint256 hash = ArithToUint256(arith_uint256(n));
+    return GCSFilter::Element(hash.begin(), hash.end());
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included;
+    GCSFilter::ElementSet excluded;
+    for (unsigned int i = 0; i < 100; i++) {
+        included.insert(MakeElement(2 * i));
+        excluded.insert(MakeElement(2 * i + 1));
+    }
+
+    GCSFilter::Params params(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, BASIC_FILTER_P, BASIC_FILTER_M);
+    GCSFilter filter(params, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+
+    BOOST_FOREACH(const GCSFilter::Element& element, included) {
+        BOOST_CHECK(filter.Match(element));
+
+        GCSFilter::ElementSet query = excluded;
+        query.insert(element);
+        BOOST_CHECK(filter.MatchAny(query));
+    }
+
+    // With a false positive rate of 1 / 784931 none of these fixed elements match
+    BOOST_FOREACH(const GCSFilter::Element& element, excluded)
+        BOOST_CHECK(!filter.Match(element));
+    BOOST_CHECK(!filter.MatchAny(excluded));
+
+    // Decoding the encoded filter gives back the same set
+    GCSFilter decoded(params, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    BOOST_FOREACH(const GCSFilter::Element& element, included)
+        BOOST_CHECK(decoded.Match(element));
+
+    // A truncated filter is rejected
+    std::vector<unsigned char> vchTruncated(filter.GetEncoded().begin(), filter.GetEncoded().end() - 10);
+    BOOST_CHECK_THROW(GCSFilter(params, vchTruncated), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_empty)
+{
+    GCSFilter::Params params(0, 0, BASIC_FILTER_P, BASIC_FILTER_M);
+    GCSFilter filter(params, GCSFilter::ElementSet());
+    BOOST_CHECK_EQUAL(filter.GetN(), 0U);
+    BOOST_CHECK(filter.GetEncoded() == std::vector<unsigned char>(1, 0));
+    BOOST_CHECK(!filter.Match(MakeElement(0)));
+    BOOST_CHECK(filter.GetEncoded() == GCSFilter(params).GetEncoded());
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic)
+{
+    CScript scriptIncluded1 = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript scriptIncluded2 = CScript() << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUAL;
+    CScript scriptSpent = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript scriptOpReturn = CScript() << OP_RETURN << std::vector<unsigned char>(4, 4);
+    CScript scriptUnrelated = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 5) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_1;
+    coinbase.vout.push_back(CTxOut(50 * COIN, scriptIncluded1));
+    coinbase.vout.push_back(CTxOut(0, scriptOpReturn));
+    coinbase.vout.push_back(CTxOut(0, CScript()));
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.push_back(CTxOut(1 * COIN, scriptIncluded2));
+
+    CBlock block;
+    block.vtx.push_back(coinbase);
+    block.vtx.push_back(tx);
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(2 * COIN, scriptSpent)));
+
+    CBlockFilter blockfilter(BLOCK_FILTER_BASIC, block, blockundo);
+    const GCSFilter& filter = blockfilter.GetFilter();
+    BOOST_CHECK(blockfilter.GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(filter.GetN(), 3U);
+    BOOST_CHECK(filter.Match(GCSFilter::Element(scriptIncluded1.begin(), scriptIncluded1.end())));
+    BOOST_CHECK(filter.Match(GCSFilter::Element(scriptIncluded2.begin(), scriptIncluded2.end())));
+    BOOST_CHECK(filter.Match(GCSFilter::Element(scriptSpent.begin(), scriptSpent.end())));
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(scriptOpReturn.begin(), scriptOpReturn.end())));
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(scriptUnrelated.begin(), scriptUnrelated.end())));
+
+    // Round trip through the cfilter message serialization
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << blockfilter;
+    CBlockFilter blockfilter2;
+    stream >> blockfilter2;
+    BOOST_CHECK(blockfilter2.GetFilterType() == BLOCK_FILTER_BASIC);
+    BOOST_CHECK(blockfilter2.GetBlockHash() == blockfilter.GetBlockHash());
+    BOOST_CHECK(blockfilter2.GetEncodedFilter() == blockfilter.GetEncodedFilter());
+    BOOST_CHECK(blockfilter2.GetHash() == blockfilter.GetHash());
+
+    // The filter hash and header are those of BIP157
+    const std::vector<unsigned char>& vchFilter = blockfilter.GetEncodedFilter();
+    uint256 hashFilter = Hash(vchFilter.begin(), vchFilter.end());
+    BOOST_CHECK(blockfilter.GetHash() == hashFilter);
+    uint256 hashPrevHeader = GetRandHash();
+    BOOST_CHECK(blockfilter.ComputeHeader(hashPrevHeader) == Hash(hashFilter.begin(), hashFilter.end(), hashPrevHeader.begin(), hashPrevHeader.end()));
+
+    // Filters of different blocks are keyed differently
+    block.nNonce++;
+    CBlockFilter blockfilterOther(BLOCK_FILTER_BASIC, block, blockundo);
+    BOOST_CHECK(blockfilterOther.GetEncodedFilter() != blockfilter.GetEncodedFilter());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
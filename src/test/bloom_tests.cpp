@@ -180,6 +180,42 @@ BOOST_AUTO_TEST_CASE(bloom_match)
     BOOST_CHECK_MESSAGE(!filter.IsRelevantAndUpdate(tx), "Simple Bloom filter matched COutPoint for an output we didn't care about");
 }
 
+BOOST_AUTO_TEST_CASE(bloom_match_shared_elements)
+{
+    // Same transaction as in bloom_match, matched once taken apart and once directly
+    CTransaction tx;
+    CDataStream stream(ParseHex("01000000010b26e9b7735eb6aabdf358bab62f9816a21ba9ebdb719d5299e88607d722c190000000008b4830450220070aca44506c5cef3a16ed519d7c3c39f8aab192c4e1c90d065f37b8a4af6141022100a8e160b856c2d43d27d8fba71e5aef6405b8643ac4cb7cb3c462aced7f14711a0141046d11fee51b0e60666d5049a9101a72741df480b96ee26488a4d3466b95c9a40ac5eeef87e10a5cd336c19a84565f80fa6c547957b7700ff4dfbdefe76036c339ffffffff021bff3d11000000001976a91404943fdd508053c75000106d3bc6e2754dbcff1988ac2f15de00000000001976a914a266436d2965547608b9e15d9032a7b9d64fa43188ac00000000"), SER_DISK, CLIENT_VERSION);
+    stream >> tx;
+    CBloomFilterTxElements elements(tx);
+
+    std::vector<std::vector<unsigned char> > vKeys;
+    vKeys.push_back(ParseHex("6bff7fcd4f8565ef406dd5d63d4ff94f318fe82027fd4dc451b04474019f74b4"));
+    vKeys.push_back(ParseHex("30450220070aca44506c5cef3a16ed519d7c3c39f8aab192c4e1c90d065f37b8a4af6141022100a8e160b856c2d43d27d8fba71e5aef6405b8643ac4cb7cb3c462aced7f14711a01"));
+    vKeys.push_back(ParseHex("04943fdd508053c75000106d3bc6e2754dbcff19"));
+    vKeys.push_back(ParseHex("a266436d2965547608b9e15d9032a7b9d64fa431"));
+    vKeys.push_back(ParseHex("0000006d2965547608b9e15d9032a7b9d64fa431"));
+    unsigned char flags[] = {BLOOM_UPDATE_NONE, BLOOM_UPDATE_ALL, BLOOM_UPDATE_P2PUBKEY_ONLY};
+
+    for (unsigned int k = 0; k < vKeys.size(); k++)
+    {
+        for (unsigned int i = 0; i < sizeof(flags); i++)
+        {
+            CBloomFilter filter(10, 0.000001, 0, flags[i]);
+            filter.insert(vKeys[k]);
+            CBloomFilter filterShared = filter;
+            BOOST_CHECK_EQUAL(filter.IsRelevantAndUpdate(tx), filterShared.IsRelevantAndUpdate(elements));
+
+            // Any outputs added to the filter must be the same too
+            for (unsigned int n = 0; n < tx.vout.size(); n++)
+                BOOST_CHECK_EQUAL(filter.contains(COutPoint(tx.GetHash(), n)), filterShared.contains(COutPoint(tx.GetHash(), n)));
+        }
+    }
+
+    CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(COutPoint(uint256S("0x90c122d70786e899529d71dbeba91ba216982fb6ba58f3bdaab65e73b7e9260b"), 0));
+    BOOST_CHECK_MESSAGE(filter.IsRelevantAndUpdate(elements), "Shared elements didn't match COutPoint");
+}
+
 BOOST_AUTO_TEST_CASE(merkle_block_1)
 {
     // Random real block (0000000000013b8ab2cd513b0261a14096412195a72a0c4827d229dcc7e0f7af)
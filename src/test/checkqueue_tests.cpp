@@ -0,0 +1,103 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include "test/test_credits.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+namespace {
+
+std::atomic<unsigned int> nChecksRun(0);
+
+/** Counts how often it is run; fails if fValid is unset. */
+struct CCountingCheck
+{
+    bool fValid;
+
+    CCountingCheck() : fValid(true) {}
+
+    bool operator()()
+    {
+        nChecksRun++;
+        return fValid;
+    }
+
+    void swap(CCountingCheck& x) { std::swap(fValid, x.fValid); }
+};
+
+typedef CCheckQueue<CCountingCheck> CountingQueue;
+
+void QueueThread(CountingQueue* pqueue)
+{
+    pqueue->Thread();
+}
+
+/**
+ * Run nRounds rounds of checks through a queue with nThreads workers (and at
+ * most nMaxWorkers slots). In every round each check must be run exactly
+ * once, and Wait must only fail in the rounds containing an invalid check.
+ */
+void RunRounds(unsigned int nThreads, unsigned int nMaxWorkers, int nRounds)
+{
+    CountingQueue queue(16, nMaxWorkers);
+    boost::thread_group threads;
+    for (unsigned int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&QueueThread, &queue));
+
+    for (int nRound = 0; nRound < nRounds; nRound++) {
+        bool fFail = nRound % 7 == 3;
+        unsigned int nAdded = 0;
+        nChecksRun = 0;
+        {
+            CCheckQueueControl<CCountingCheck> control(&queue);
+            for (int i = 0; i < nRound % 50; i++) {
+                std::vector<CCountingCheck> vChecks(1 + i % 5);
+                if (fFail && i == 0)
+                    vChecks[0].fValid = false;
+                nAdded += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK_EQUAL(control.Wait(), !(fFail && nAdded > 0));
+        }
+        // After a failure the remaining checks may be skipped
+        if (!fFail)
+            BOOST_CHECK_EQUAL(nChecksRun.load(), nAdded);
+        else
+            BOOST_CHECK(nChecksRun.load() <= nAdded);
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_no_workers)
+{
+    RunRounds(0, 4, 200);
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_workers)
+{
+    RunRounds(1, 4, 200);
+    RunRounds(4, 4, 200);
+}
+
+/* More workers than slots share deques. */
+BOOST_AUTO_TEST_CASE(checkqueue_shared_slots)
+{
+    RunRounds(8, 2, 200);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
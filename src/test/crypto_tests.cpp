@@ -9,7 +9,9 @@
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
 
+#include "hash.h"
 #include "test_random.h"
+#include "uint256.h"
 #include "utilstrencodings.h"
 #include "test/test_credits.h"
 
@@ -134,6 +136,78 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256_implementations) {
+    // Hash random messages of every length up to a few chunks with the
+    // portable implementation, then check the autodetected one agrees.
+    std::vector<std::vector<unsigned char> > vMessages;
+    std::vector<std::vector<unsigned char> > vHashes;
+    BOOST_CHECK_EQUAL(SHA256AutoDetect(SHA256_STANDARD), "standard");
+    for (size_t len = 0; len < 64 * 5; len++) {
+        std::vector<unsigned char> vch(len), hash(CSHA256::OUTPUT_SIZE);
+        for (size_t i = 0; i < len; i++)
+            vch[i] = insecure_rand() & 0xff;
+        CSHA256().Write(vch.data(), vch.size()).Finalize(&hash[0]);
+        vMessages.push_back(vch);
+        vHashes.push_back(hash);
+    }
+
+    std::string strImpl = SHA256AutoDetect();
+    BOOST_TEST_MESSAGE("Using the '" + strImpl + "' SHA256 implementation");
+    for (size_t i = 0; i < vMessages.size(); i++)
+        TestVector(CSHA256(), vMessages[i], vHashes[i]);
+    TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    TestSHA256(std::string(1000000, 'a'),
+               "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64) {
+    // Check the batched double-SHA256 functions against Hash() with every
+    // implementation this CPU supports, including the multi-lane ones.
+    const int vAllowed[] = {SHA256_STANDARD, SHA256_USE_SSE41, SHA256_USE_AVX2, SHA256_USE_ALL};
+    for (unsigned int n = 0; n < sizeof(vAllowed) / sizeof(vAllowed[0]); n++) {
+        BOOST_TEST_MESSAGE("Using the '" + SHA256AutoDetect(vAllowed[n]) + "' SHA256 implementation");
+        for (int i = 0; i <= 34; i++) {
+            std::vector<unsigned char> in(64 * i), out(32 * i), expected(32 * i);
+            for (size_t j = 0; j < in.size(); j++)
+                in[j] = insecure_rand() & 0xff;
+            for (int j = 0; j < i; j++) {
+                uint256 hash = Hash(in.begin() + 64 * j, in.begin() + 64 * j + 64);
+                memcpy(&expected[32 * j], hash.begin(), 32);
+            }
+            SHA256D64(out.data(), in.data(), i);
+            BOOST_CHECK(out == expected);
+            // In place, as the merkle root computation does it.
+            SHA256D64(in.data(), in.data(), i);
+            BOOST_CHECK(std::equal(expected.begin(), expected.end(), in.begin()));
+        }
+
+        // Messages of every length around the padding boundaries, and a few
+        // long ones so that lanes finish at different times.
+        std::vector<std::vector<unsigned char> > vMessages;
+        for (size_t len = 0; len < 200; len++)
+            vMessages.push_back(std::vector<unsigned char>(len));
+        for (int i = 0; i < 10; i++)
+            vMessages.push_back(std::vector<unsigned char>(insecure_rand() % 5000));
+        std::vector<const unsigned char*> vInputs;
+        std::vector<size_t> vLens;
+        for (size_t i = 0; i < vMessages.size(); i++) {
+            for (size_t j = 0; j < vMessages[i].size(); j++)
+                vMessages[i][j] = insecure_rand() & 0xff;
+            vInputs.push_back(vMessages[i].data());
+            vLens.push_back(vMessages[i].size());
+        }
+        for (size_t count = 0; count <= vMessages.size(); count += 1 + count / 2) {
+            std::vector<unsigned char> out(32 * count);
+            SHA256DMulti(out.data(), vInputs.data(), vLens.data(), count);
+            for (size_t i = 0; i < count; i++) {
+                uint256 hash = Hash(vMessages[i].begin(), vMessages[i].end());
+                BOOST_CHECK(memcmp(&out[32 * i], hash.begin(), 32) == 0);
+            }
+        }
+    }
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -0,0 +1,119 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "uint256.h"
+
+#include "test/test_credits.h"
+#include "test/test_random.h"
+
+#include <cstring>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+namespace {
+
+struct UInt256Hasher
+{
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select < 8, "UInt256Hasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+typedef CuckooCache::cache<uint256, UInt256Hasher> cache_type;
+
+void FillRandom(std::vector<uint256>& v, size_t n)
+{
+    v.resize(n);
+    for (size_t i = 0; i < n; i++)
+        for (int j = 0; j < 8; j++)
+            *(uint32_t*)(v[i].begin() + 4 * j) = insecure_rand();
+}
+
+/** Insert n random elements into a cache holding bytes worth of entries and
+ * return the fraction of them that can be found afterwards. */
+double HitRate(size_t bytes, double load)
+{
+    cache_type cc;
+    size_t nElems = cc.setup_bytes(bytes);
+    std::vector<uint256> v;
+    FillRandom(v, (size_t)(load * nElems));
+    for (size_t i = 0; i < v.size(); i++)
+        cc.insert(v[i]);
+
+    size_t nHits = 0;
+    for (size_t i = 0; i < v.size(); i++)
+        if (cc.contains(v[i], false))
+            nHits++;
+    return (double)nHits / v.size();
+}
+
+}
+
+/* Elements that were never inserted must never be reported as present. */
+BOOST_AUTO_TEST_CASE(cuckoocache_no_fakes)
+{
+    seed_insecure_rand(true);
+    cache_type cc;
+    size_t nElems = cc.setup_bytes(1 << 20);
+    std::vector<uint256> v;
+    FillRandom(v, 2 * nElems);
+    for (size_t i = 0; i < nElems; i++)
+        cc.insert(v[i]);
+    for (size_t i = nElems; i < v.size(); i++)
+        BOOST_CHECK(!cc.contains(v[i], false));
+}
+
+/* Below the epoch threshold nearly everything inserted stays in the cache. */
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate)
+{
+    seed_insecure_rand(true);
+    BOOST_CHECK(HitRate(1 << 20, 0.4) > 0.99);
+    BOOST_CHECK(HitRate(1 << 20, 0.9) > 0.95);
+}
+
+/* Entries looked up with erase set are reused before live entries once the
+ * cache is full. */
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    seed_insecure_rand(true);
+    cache_type cc;
+    size_t nElems = cc.setup_bytes(1 << 20);
+    size_t nFill = (nElems * 9) / 10;
+    std::vector<uint256> v;
+    FillRandom(v, nFill + nFill / 2);
+
+    // Fill the cache to 90%, then erase the first half of those entries
+    for (size_t i = 0; i < nFill; i++)
+        cc.insert(v[i]);
+    size_t nErased = 0;
+    for (size_t i = 0; i < nFill / 2; i++)
+        nErased += cc.contains(v[i], true);
+    BOOST_CHECK(nErased > (size_t)((nFill / 2) * 0.95));
+
+    // Erased entries are still found until their slots are needed
+    size_t nFound = 0;
+    for (size_t i = 0; i < nFill / 2; i++)
+        nFound += cc.contains(v[i], false);
+    BOOST_CHECK_EQUAL(nFound, nErased);
+
+    // New entries should displace the erased ones, not the live ones
+    for (size_t i = nFill; i < v.size(); i++)
+        cc.insert(v[i]);
+    size_t nLive = 0;
+    for (size_t i = nFill / 2; i < nFill; i++)
+        nLive += cc.contains(v[i], false);
+    BOOST_CHECK(nLive > (size_t)((nFill - nFill / 2) * 0.95));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -125,6 +125,66 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_readmany)
+{
+    // Perform tests both obfuscated and non-obfuscated.
+    for (int i = 0; i < 2; i++) {
+        bool obfuscate = (bool)i;
+        path ph = temp_directory_path() / unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        // Write every other key, then read all of them back in reverse
+        // order, including a duplicate and a key past the end.
+        std::vector<std::pair<char, uint32_t> > keys;
+        std::vector<uint256> in;
+        for (uint32_t x = 0; x < 100; x++) {
+            in.push_back(GetRandHash());
+            if (x % 2 == 0)
+                BOOST_CHECK(dbw.Write(std::make_pair('r', x), in[x]));
+            keys.push_back(std::make_pair('r', 99 - x));
+        }
+        keys.push_back(std::make_pair('r', (uint32_t)10));
+        keys.push_back(std::make_pair('s', (uint32_t)0));
+
+        std::vector<uint256> values;
+        std::vector<bool> vFound;
+        BOOST_CHECK_EQUAL(dbw.ReadMany(keys, values, vFound), 51U);
+        BOOST_CHECK_EQUAL(values.size(), keys.size());
+        for (size_t n = 0; n < keys.size(); n++) {
+            uint256 res;
+            BOOST_CHECK_EQUAL(vFound[n], dbw.Read(keys[n], res));
+            if (vFound[n])
+                BOOST_CHECK_EQUAL(values[n].ToString(), res.ToString());
+        }
+        BOOST_CHECK(vFound[100] && values[100] == in[10]);
+        BOOST_CHECK(!vFound[101]);
+    }
+}
+
+// XorObfuscate must match CDataStream::Xor for every length and key size,
+// both out of place and in place.
+BOOST_AUTO_TEST_CASE(dbwrapper_xor_obfuscate)
+{
+    for (unsigned int nKeySize = 0; nKeySize <= 9; nKeySize++) {
+        std::vector<unsigned char> key(nKeySize);
+        GetRandBytes(key.data(), key.size());
+        for (unsigned int nSize = 0; nSize < 40; nSize++) {
+            std::vector<char> in(nSize);
+            GetRandBytes((unsigned char*)in.data(), in.size());
+
+            CDataStream expected(in, SER_DISK, CLIENT_VERSION);
+            expected.Xor(key);
+
+            std::vector<char> out(nSize);
+            XorObfuscate(out.data(), in.data(), in.size(), key);
+            BOOST_CHECK(std::equal(out.begin(), out.end(), expected.begin()));
+
+            XorObfuscate(in.data(), in.data(), in.size(), key);
+            BOOST_CHECK(in == out);
+        }
+    }
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
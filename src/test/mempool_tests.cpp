@@ -2,12 +2,16 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "consensus/validation.h"
+#include "main.h"
+#include "script/interpreter.h"
 #include "txmempool.h"
 #include "util.h"
 
 #include "test/test_credits.h"
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <list>
 #include <vector>
 
@@ -318,6 +322,125 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    entry.hadNoDependencies = true;
+
+    /* 3rd highest fee */
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).Priority(10.0).FromTx(tx1));
+
+    /* highest fee */
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 2 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(20000LL).Priority(9.0).FromTx(tx2));
+    uint64_t tx2Size = ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION);
+
+    /* lowest fee */
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 5 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(0LL).Priority(100.0).FromTx(tx3));
+
+    /* 2nd highest fee */
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx4.vout[0].nValue = 6 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(15000LL).Priority(1.0).FromTx(tx4));
+
+    /* equal fee rate to tx1, but newer */
+    CMutableTransaction tx5 = CMutableTransaction();
+    tx5.vout.resize(1);
+    tx5.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx5.vout[0].nValue = 11 * COIN;
+    entry.nTime = 1;
+    entry.dPriority = 10.0;
+    pool.addUnchecked(tx5.GetHash(), entry.Fee(10000LL).FromTx(tx5));
+    BOOST_CHECK_EQUAL(pool.size(), 5);
+
+    std::vector<std::string> sortedOrder;
+    sortedOrder.resize(5);
+    sortedOrder[0] = tx2.GetHash().ToString(); // 20000
+    sortedOrder[1] = tx4.GetHash().ToString(); // 15000
+    // tx1 and tx5 are both 10000
+    // Ties are broken by hash, not timestamp, so determine which
+    // hash comes first.
+    if (tx1.GetHash() < tx5.GetHash()) {
+        sortedOrder[2] = tx1.GetHash().ToString();
+        sortedOrder[3] = tx5.GetHash().ToString();
+    } else {
+        sortedOrder[2] = tx5.GetHash().ToString();
+        sortedOrder[3] = tx1.GetHash().ToString();
+    }
+    sortedOrder[4] = tx3.GetHash().ToString(); // 0
+
+    CheckSort<4>(pool, sortedOrder);
+
+    /* low fee parent with high fee child */
+    /* tx6 (0) -> tx7 (high) */
+    CMutableTransaction tx6 = CMutableTransaction();
+    tx6.vout.resize(1);
+    tx6.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx6.vout[0].nValue = 20 * COIN;
+    uint64_t tx6Size = ::GetSerializeSize(tx6, SER_NETWORK, PROTOCOL_VERSION);
+
+    pool.addUnchecked(tx6.GetHash(), entry.Fee(0LL).FromTx(tx6));
+    BOOST_CHECK_EQUAL(pool.size(), 6);
+    // Ties are broken by hash
+    if (tx3.GetHash() < tx6.GetHash())
+        sortedOrder.push_back(tx6.GetHash().ToString());
+    else
+        sortedOrder.insert(sortedOrder.end()-1, tx6.GetHash().ToString());
+    CheckSort<4>(pool, sortedOrder);
+
+    CMutableTransaction tx7 = CMutableTransaction();
+    tx7.vin.resize(1);
+    tx7.vin[0].prevout = COutPoint(tx6.GetHash(), 0);
+    tx7.vin[0].scriptSig = CScript() << OP_11;
+    tx7.vout.resize(1);
+    tx7.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx7.vout[0].nValue = 10 * COIN;
+    uint64_t tx7Size = ::GetSerializeSize(tx7, SER_NETWORK, PROTOCOL_VERSION);
+
+    /* set the fee to just below tx2's feerate when including ancestor */
+    CAmount fee = (20000/tx2Size)*(tx7Size + tx6Size) - 1;
+
+    pool.addUnchecked(tx7.GetHash(), entry.Fee(fee).FromTx(tx7));
+    BOOST_CHECK_EQUAL(pool.size(), 7);
+    sortedOrder.insert(sortedOrder.begin()+1, tx7.GetHash().ToString());
+    CheckSort<4>(pool, sortedOrder);
+
+    CTxMemPool::txiter it7 = pool.mapTx.find(tx7.GetHash());
+    BOOST_CHECK_EQUAL(it7->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(it7->GetSizeWithAncestors(), tx6Size + tx7Size);
+    BOOST_CHECK_EQUAL(it7->GetModFeesWithAncestors(), fee);
+
+    /* after tx6 is mined, tx7 should move up in the sort */
+    std::vector<CTransaction> vtx;
+    vtx.push_back(tx6);
+    std::list<CTransaction> dummy;
+    pool.removeForBlock(vtx, 1, dummy, false);
+
+    sortedOrder.erase(sortedOrder.begin()+1);
+    sortedOrder.erase(std::find(sortedOrder.begin(), sortedOrder.end(), tx6.GetHash().ToString()));
+    sortedOrder.insert(sortedOrder.begin(), tx7.GetHash().ToString());
+    CheckSort<4>(pool, sortedOrder);
+
+    it7 = pool.mapTx.find(tx7.GetHash());
+    BOOST_CHECK_EQUAL(it7->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(it7->GetSizeWithAncestors(), tx7Size);
+    BOOST_CHECK_EQUAL(it7->GetModFeesWithAncestors(), fee);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool(CFeeRate(1000));
@@ -473,4 +596,133 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(DisconnectPoolOrderTest)
+{
+    // Two blocks, each with a parent and a child spending it; the child of
+    // the higher block spends the child of the lower one.
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].prevout = COutPoint(txChild.GetHash(), 0);
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 8 * COIN;
+
+    CMutableTransaction txGreatGrandChild;
+    txGreatGrandChild.vin.resize(1);
+    txGreatGrandChild.vin[0].prevout = COutPoint(txGrandChild.GetHash(), 0);
+    txGreatGrandChild.vout.resize(1);
+    txGreatGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGreatGrandChild.vout[0].nValue = 7 * COIN;
+
+    std::vector<CTransaction> vtxLower, vtxHigher;
+    vtxLower.push_back(txParent);
+    vtxLower.push_back(txChild);
+    vtxHigher.push_back(txGrandChild);
+    vtxHigher.push_back(txGreatGrandChild);
+
+    // Disconnect the higher block first, as DisconnectTip does
+    DisconnectedBlockTransactions disconnectpool;
+    BOOST_REVERSE_FOREACH(const CTransaction& tx, vtxHigher)
+        disconnectpool.addTransaction(MakeTransactionRef(tx));
+    BOOST_REVERSE_FOREACH(const CTransaction& tx, vtxLower)
+        disconnectpool.addTransaction(MakeTransactionRef(tx));
+    BOOST_CHECK_EQUAL(disconnectpool.size(), 4);
+    BOOST_CHECK(disconnectpool.CreditsMemoryUsage() > 0);
+
+    std::vector<CTransactionRef> vtx;
+    disconnectpool.takeInMempoolOrder(vtx);
+    BOOST_CHECK_EQUAL(disconnectpool.size(), 0);
+    BOOST_CHECK_EQUAL(disconnectpool.CreditsMemoryUsage(), 0);
+    BOOST_REQUIRE_EQUAL(vtx.size(), 4);
+    BOOST_CHECK(vtx[0]->GetHash() == txParent.GetHash());
+    BOOST_CHECK(vtx[1]->GetHash() == txChild.GetHash());
+    BOOST_CHECK(vtx[2]->GetHash() == txGrandChild.GetHash());
+    BOOST_CHECK(vtx[3]->GetHash() == txGreatGrandChild.GetHash());
+
+    // Transactions confirmed again by the new chain are dropped, and the
+    // highest block is the first to go when the pool is trimmed.
+    BOOST_REVERSE_FOREACH(const CTransaction& tx, vtxHigher)
+        disconnectpool.addTransaction(MakeTransactionRef(tx));
+    BOOST_REVERSE_FOREACH(const CTransaction& tx, vtxLower)
+        disconnectpool.addTransaction(MakeTransactionRef(tx));
+    std::vector<CTransaction> vtxConfirmed(1, txParent);
+    disconnectpool.removeForBlock(vtxConfirmed);
+    BOOST_CHECK_EQUAL(disconnectpool.size(), 3);
+    CTransactionRef ptxNewest = disconnectpool.removeNewest();
+    BOOST_REQUIRE(ptxNewest);
+    BOOST_CHECK(ptxNewest->GetHash() == txGreatGrandChild.GetHash());
+    disconnectpool.takeInMempoolOrder(vtx);
+    BOOST_REQUIRE_EQUAL(vtx.size(), 2);
+    BOOST_CHECK(vtx[0]->GetHash() == txChild.GetHash());
+    BOOST_CHECK(vtx[1]->GetHash() == txGrandChild.GetHash());
+    BOOST_CHECK(!disconnectpool.removeNewest());
+}
+
+
+static void SignP2PK(CMutableTransaction& tx, const CKey& key, const CScript& scriptPubKey)
+{
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig = CScript() << vchSig;
+}
+
+BOOST_FIXTURE_TEST_CASE(MempoolDumpLoadTest, TestChain100Setup)
+{
+    // A parent and a child whose txid sorts before the parent's, so that
+    // the pool's txid order has the child first.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = scriptPubKey;
+    txParent.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - CENT;
+    SignP2PK(txParent, coinbaseKey, coinbaseTxns[0].vout[0].scriptPubKey);
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = scriptPubKey;
+    txChild.vout[0].nValue = txParent.vout[0].nValue - CENT;
+    do {
+        txChild.vout[0].nValue--;
+        SignP2PK(txChild, coinbaseKey, scriptPubKey);
+    } while (!(txChild.GetHash() < txParent.GetHash()));
+
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, txParent, false, NULL, true, false));
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, txChild, false, NULL, true, false));
+    }
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+
+    DumpMempool();
+    mempool.clear();
+    BOOST_CHECK(LoadMempool());
+
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+    BOOST_CHECK(mempool.exists(txParent.GetHash()));
+    BOOST_CHECK(mempool.exists(txChild.GetHash()));
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "consensus/merkle.h"
+#include "crypto/sha256.h"
+#include "streams.h"
 #include "test/test_credits.h"
 #include "test_random.h"
 
@@ -133,4 +135,63 @@ BOOST_AUTO_TEST_CASE(merkle_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(merkle_test_implementations)
+{
+    // The level by level computation must give the same roots and mutation
+    // flags as the branch computation, whichever SHA256 implementation it
+    // batches the tree levels on.
+    const int vAllowed[] = {SHA256_STANDARD, SHA256_USE_SSE41, SHA256_USE_AVX2, SHA256_USE_ALL};
+    for (int i = 0; i < 40; i++) {
+        int nLeaves = (i <= 20) ? i : 21 + (insecure_rand() % 3000);
+        std::vector<uint256> leaves(nLeaves);
+        for (int j = 0; j < nLeaves; j++)
+            leaves[j] = GetRandHash();
+        // Sometimes make two neighbours equal, which may or may not be siblings.
+        if (nLeaves > 2 && (i & 1)) {
+            int pos = insecure_rand() % (nLeaves - 1);
+            leaves[pos + 1] = leaves[pos];
+        }
+        SHA256AutoDetect(SHA256_STANDARD);
+        bool fMutated = false;
+        uint256 root = ComputeMerkleRoot(leaves, &fMutated);
+        if (nLeaves > 0)
+            BOOST_CHECK(root == ComputeMerkleRootFromBranch(leaves[0], ComputeMerkleBranch(leaves, 0), 0));
+        for (unsigned int n = 0; n < sizeof(vAllowed) / sizeof(vAllowed[0]); n++) {
+            SHA256AutoDetect(vAllowed[n]);
+            bool fMutatedImpl = !fMutated;
+            BOOST_CHECK(ComputeMerkleRoot(leaves, &fMutatedImpl) == root);
+            BOOST_CHECK_EQUAL(fMutatedImpl, fMutated);
+        }
+    }
+    SHA256AutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(merkle_test_block_txids)
+{
+    // Transactions read as part of a block are hashed in one batch; their
+    // hashes must match hashing them one at a time.
+    CBlock block;
+    for (int i = 0; i < 100; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1 + insecure_rand() % 5);
+        for (size_t j = 0; j < mtx.vin.size(); j++) {
+            mtx.vin[j].prevout = COutPoint(GetRandHash(), j);
+            mtx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(insecure_rand() % 200, j);
+        }
+        mtx.vout.resize(1 + insecure_rand() % 5);
+        mtx.nLockTime = i;
+        block.vtx.push_back(mtx);
+    }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    CBlock block2;
+    ss >> block2;
+    BOOST_CHECK_EQUAL(block2.vtx.size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK(block2.vtx[i].GetHash() == block.vtx[i].GetHash());
+        BOOST_CHECK(block2.vtx[i].GetHash() == CMutableTransaction(block.vtx[i]).GetHash());
+    }
+    BOOST_CHECK(BlockMerkleRoot(block2) == BlockMerkleRoot(block));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
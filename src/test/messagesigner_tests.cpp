@@ -0,0 +1,57 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "messagesigner.h"
+
+#include "hash.h"
+#include "key.h"
+#include "test/test_credits.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(messagesigner_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(messagesigner_verify)
+{
+    CKey key, keyOther, keyUncompressed;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    keyUncompressed.Set(key.begin(), key.end(), false);
+    CPubKey pubkey = key.GetPubKey();
+
+    std::string strError;
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(CMessageSigner::SignMessage("message", vchSig, key));
+
+    // Check twice, so the second time is answered from the cache.
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(CMessageSigner::VerifyMessage(pubkey, vchSig, "message", strError));
+        BOOST_CHECK(!CMessageSigner::VerifyMessage(pubkey, vchSig, "other message", strError));
+        BOOST_CHECK(!CMessageSigner::VerifyMessage(keyOther.GetPubKey(), vchSig, "message", strError));
+        // The same key, but a signature that recovers the compressed encoding.
+        BOOST_CHECK(!CMessageSigner::VerifyMessage(keyUncompressed.GetPubKey(), vchSig, "message", strError));
+    }
+
+    uint256 hash = Hash(vchSig.begin(), vchSig.end());
+    BOOST_CHECK(CHashSigner::SignHash(hash, keyUncompressed, vchSig));
+    BOOST_CHECK(CHashSigner::VerifyHash(hash, keyUncompressed.GetPubKey(), vchSig, strError));
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, pubkey, vchSig, strError));
+
+    // Altering the recovery id recovers a different key, which must be
+    // rejected even though r and s are unchanged.
+    std::vector<unsigned char> vchSigAltered(vchSig);
+    vchSigAltered[0] ^= 1;
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, keyUncompressed.GetPubKey(), vchSigAltered, strError));
+    vchSigAltered = vchSig;
+    vchSigAltered[10] ^= 1;
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, keyUncompressed.GetPubKey(), vchSigAltered, strError));
+    vchSigAltered.resize(64);
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, keyUncompressed.GetPubKey(), vchSigAltered, strError));
+    BOOST_CHECK(CHashSigner::VerifyHash(hash, keyUncompressed.GetPubKey(), vchSig, strError));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
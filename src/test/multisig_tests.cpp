@@ -315,4 +315,68 @@ BOOST_AUTO_TEST_CASE(multisig_Sign)
 }
 
 
+BOOST_AUTO_TEST_CASE(multisig_SignSignatures)
+{
+    // SignSignatures() must produce exactly what SignSignature() does input
+    // by input, whether it signs on one thread or several
+    CBasicKeyStore keystore;
+    CKey key[4];
+    for (int i = 0; i < 4; i++)
+    {
+        key[i].MakeNewKey(true);
+        if (i < 3)
+            keystore.AddKey(key[i]);
+    }
+
+    CScript escrow;
+    escrow << OP_2 << ToByteVector(key[0].GetPubKey()) << ToByteVector(key[3].GetPubKey()) << ToByteVector(key[2].GetPubKey()) << OP_3 << OP_CHECKMULTISIG;
+    keystore.AddCScript(escrow);
+
+    CScript scripts[5];
+    scripts[0] << ToByteVector(key[0].GetPubKey()) << OP_CHECKSIG;
+    scripts[1] = GetScriptForDestination(key[1].GetPubKey().GetID());
+    scripts[2] = escrow;
+    scripts[3] = GetScriptForDestination(CScriptID(escrow));
+    scripts[4] = GetScriptForDestination(key[3].GetPubKey().GetID()); // not in keystore
+
+    CMutableTransaction txFrom;
+    txFrom.vout.resize(100);
+    for (unsigned int i = 0; i < txFrom.vout.size(); i++)
+        txFrom.vout[i].scriptPubKey = scripts[i % 4];
+
+    CMutableTransaction txTo;
+    txTo.vin.resize(txFrom.vout.size());
+    txTo.vout.resize(1);
+    txTo.vout[0].nValue = 1;
+    std::vector<std::pair<unsigned int, CScript> > vInputs;
+    for (unsigned int i = 0; i < txTo.vin.size(); i++)
+    {
+        txTo.vin[i].prevout.n = i;
+        txTo.vin[i].prevout.hash = txFrom.GetHash();
+        vInputs.push_back(std::make_pair(i, txFrom.vout[i].scriptPubKey));
+    }
+
+    for (int nFail = 0; nFail < 2; nFail++)
+    {
+        if (nFail)
+        {
+            txFrom.vout[57].scriptPubKey = scripts[4];
+            vInputs[57].second = scripts[4];
+        }
+
+        CMutableTransaction txExpected(txTo);
+        bool fExpected = true;
+        for (unsigned int i = 0; i < txExpected.vin.size(); i++)
+            fExpected &= SignSignature(keystore, txFrom, txExpected, i);
+        BOOST_CHECK(fExpected == !nFail);
+
+        for (unsigned int nThreads = 1; nThreads <= 4; nThreads += 3)
+        {
+            CMutableTransaction txSigned(txTo);
+            BOOST_CHECK(SignSignatures(keystore, txSigned, vInputs, SIGHASH_ALL, nThreads) == fExpected);
+            BOOST_CHECK(CTransaction(txSigned) == CTransaction(txExpected));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
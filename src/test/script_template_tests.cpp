@@ -0,0 +1,245 @@
+// Copyright (c) 2017 Credits Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "core_io.h"
+#include "hash.h"
+#include "key.h"
+#include "policy/policy.h"
+#include "primitives/transaction.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+#include "script/script_error.h"
+#include "script/standard.h"
+#include "util.h"
+
+#include "test/test_credits.h"
+#include "test/test_random.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+typedef std::vector<unsigned char> valtype;
+
+BOOST_FIXTURE_TEST_SUITE(script_template_tests, BasicTestingSetup)
+
+namespace {
+
+// Flag combinations to check every spend with. CLEANSTACK is only valid
+// together with P2SH.
+static const unsigned int flagSets[] = {
+    SCRIPT_VERIFY_NONE,
+    SCRIPT_VERIFY_P2SH,
+    SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC,
+    SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_LOW_S,
+    SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_MINIMALDATA | SCRIPT_VERIFY_NULLDUMMY,
+    SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_SIGPUSHONLY,
+    MANDATORY_SCRIPT_VERIFY_FLAGS,
+    STANDARD_SCRIPT_VERIFY_FLAGS,
+};
+
+unsigned int nHandled = 0;
+
+/**
+ * Verify the spend with every flag set, and check that whenever the template
+ * verifier handles it, it agrees with the generic interpreter on both the
+ * result and the error.
+ */
+void CheckSpend(const CScript& scriptSig, const CScript& scriptPubKey, const CMutableTransaction& txSpend)
+{
+    MutableTransactionSignatureChecker checker(&txSpend, 0);
+    for (unsigned int i = 0; i < sizeof(flagSets) / sizeof(flagSets[0]); i++) {
+        unsigned int flags = flagSets[i];
+        ScriptError errGeneric, errTemplate;
+        bool fGeneric = VerifyScriptGeneric(scriptSig, scriptPubKey, flags, checker, &errGeneric);
+        bool fTemplate = false;
+        if (VerifyScriptTemplate(scriptSig, scriptPubKey, flags, checker, &errTemplate, fTemplate)) {
+            nHandled++;
+            BOOST_CHECK_MESSAGE(fTemplate == fGeneric && errTemplate == errGeneric,
+                strprintf("template %d (%s), generic %d (%s) for %s with flags %x", fTemplate, ScriptErrorString(errTemplate),
+                          fGeneric, ScriptErrorString(errGeneric), ScriptToAsmStr(scriptSig), flags));
+        }
+        ScriptError err;
+        BOOST_CHECK_EQUAL(VerifyScript(scriptSig, scriptPubKey, flags, checker, &err), fGeneric);
+        BOOST_CHECK_EQUAL(err, errGeneric);
+    }
+}
+
+/** Check the spend, and copies of it with a random byte changed */
+void CheckSpendAndMutations(const CScript& scriptSig, const CScript& scriptPubKey, const CMutableTransaction& txSpend)
+{
+    CheckSpend(scriptSig, scriptPubKey, txSpend);
+    for (int i = 0; i < 16; i++) {
+        CScript scriptMutated(scriptSig);
+        scriptMutated[insecure_rand() % scriptMutated.size()] ^= (1 << (insecure_rand() % 8));
+        CheckSpend(scriptMutated, scriptPubKey, txSpend);
+    }
+}
+
+valtype Sign(const CKey& key, const CScript& scriptCode, const CMutableTransaction& txSpend, int nHashType = SIGHASH_ALL)
+{
+    valtype vchSig;
+    uint256 hash = SignatureHash(scriptCode, txSpend, 0, nHashType);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)nHashType);
+    return vchSig;
+}
+
+CMutableTransaction BuildSpend(const CScript& scriptPubKey)
+{
+    CMutableTransaction txCredit;
+    txCredit.vin.resize(1);
+    txCredit.vout.resize(1);
+    txCredit.vout[0].scriptPubKey = scriptPubKey;
+    txCredit.vout[0].nValue = 1;
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txCredit.GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 1;
+    return txSpend;
+}
+
+/** The same public key in hybrid encoding (0x06/0x07 prefix) */
+valtype HybridPubKey(const CPubKey& pubkey)
+{
+    valtype vch(pubkey.begin(), pubkey.end());
+    vch[0] = 0x06 | (vch[64] & 1);
+    return vch;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(script_template_p2pkh)
+{
+    seed_insecure_rand(true);
+    nHandled = 0;
+    CKey key, keyUncompressed, keyOther;
+    key.MakeNewKey(true);
+    keyUncompressed.MakeNewKey(false);
+    keyOther.MakeNewKey(true);
+
+    std::vector<valtype> vPubKeys;
+    vPubKeys.push_back(ToByteVector(key.GetPubKey()));
+    vPubKeys.push_back(ToByteVector(keyUncompressed.GetPubKey()));
+    vPubKeys.push_back(HybridPubKey(keyUncompressed.GetPubKey()));
+
+    for (unsigned int i = 0; i < vPubKeys.size(); i++) {
+        const valtype& vchPubKey = vPubKeys[i];
+        const CKey& signer = i == 0 ? key : keyUncompressed;
+        CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(Hash160(vchPubKey)) << OP_EQUALVERIFY << OP_CHECKSIG;
+        CMutableTransaction txSpend = BuildSpend(scriptPubKey);
+
+        valtype vchSig = Sign(signer, scriptPubKey, txSpend);
+        CheckSpendAndMutations(CScript() << vchSig << vchPubKey, scriptPubKey, txSpend);
+
+        // Other hash types, including undefined ones
+        CheckSpend(CScript() << Sign(signer, scriptPubKey, txSpend, SIGHASH_NONE | SIGHASH_ANYONECANPAY) << vchPubKey, scriptPubKey, txSpend);
+        CheckSpend(CScript() << Sign(signer, scriptPubKey, txSpend, 0x84) << vchPubKey, scriptPubKey, txSpend);
+
+        // Wrong signer, wrong key, empty and truncated signatures
+        CheckSpend(CScript() << Sign(keyOther, scriptPubKey, txSpend) << vchPubKey, scriptPubKey, txSpend);
+        CheckSpend(CScript() << vchSig << ToByteVector(keyOther.GetPubKey()), scriptPubKey, txSpend);
+        CheckSpend(CScript() << valtype() << vchPubKey, scriptPubKey, txSpend);
+        CheckSpend(CScript() << valtype(vchSig.begin(), vchSig.end() - 2) << vchPubKey, scriptPubKey, txSpend);
+
+        // Non-minimal pushes, non-push opcodes and the wrong number of pushes
+        CScript scriptPushData1;
+        scriptPushData1.insert(scriptPushData1.end(), OP_PUSHDATA1);
+        scriptPushData1.insert(scriptPushData1.end(), (unsigned char)vchSig.size());
+        scriptPushData1.insert(scriptPushData1.end(), vchSig.begin(), vchSig.end());
+        scriptPushData1 << vchPubKey;
+        CheckSpend(scriptPushData1, scriptPubKey, txSpend);
+        CheckSpend(CScript() << OP_NOP << vchSig << vchPubKey, scriptPubKey, txSpend);
+        CheckSpend(CScript() << OP_1 << vchSig << vchPubKey, scriptPubKey, txSpend);
+        CheckSpend(CScript() << vchSig << vchSig << vchPubKey, scriptPubKey, txSpend);
+        CheckSpend(CScript() << vchPubKey, scriptPubKey, txSpend);
+        CheckSpend(CScript(), scriptPubKey, txSpend);
+    }
+
+    // A "signature" that is a push found in the scriptPubKey
+    valtype vchPubKey = ToByteVector(key.GetPubKey());
+    valtype vchHash = ToByteVector(Hash160(vchPubKey));
+    CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vchHash << OP_EQUALVERIFY << OP_CHECKSIG;
+    CheckSpend(CScript() << vchHash << vchPubKey, scriptPubKey, BuildSpend(scriptPubKey));
+
+    BOOST_CHECK(nHandled > 0);
+}
+
+BOOST_AUTO_TEST_CASE(script_template_p2sh_multisig)
+{
+    seed_insecure_rand(true);
+    nHandled = 0;
+    CKey keys[4];
+    for (int i = 0; i < 4; i++)
+        keys[i].MakeNewKey(i != 2);
+
+    for (int nRequired = 1; nRequired <= 3; nRequired++) {
+        CScript redeemScript = CScript() << CScript::EncodeOP_N(nRequired);
+        for (int i = 0; i < 3; i++)
+            redeemScript << ToByteVector(keys[i].GetPubKey());
+        redeemScript << OP_3 << OP_CHECKMULTISIG;
+        valtype vchRedeemScript(redeemScript.begin(), redeemScript.end());
+        CScript scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+        CMutableTransaction txSpend = BuildSpend(scriptPubKey);
+
+        std::vector<valtype> vSigs;
+        for (int i = 0; i < 4; i++)
+            vSigs.push_back(Sign(keys[i], redeemScript, txSpend));
+
+        // Signatures in key order, out of order, and from the wrong key
+        CScript scriptSig = CScript() << OP_0;
+        for (int i = 0; i < nRequired; i++)
+            scriptSig << vSigs[i];
+        CheckSpendAndMutations(scriptSig << vchRedeemScript, scriptPubKey, txSpend);
+
+        CScript scriptReversed = CScript() << OP_0;
+        for (int i = nRequired - 1; i >= 0; i--)
+            scriptReversed << vSigs[i];
+        CheckSpend(scriptReversed << vchRedeemScript, scriptPubKey, txSpend);
+
+        CScript scriptWrongKey = CScript() << OP_0;
+        for (int i = 0; i < nRequired; i++)
+            scriptWrongKey << vSigs[i == 0 ? 3 : i];
+        CheckSpend(scriptWrongKey << vchRedeemScript, scriptPubKey, txSpend);
+
+        // Too few and too many signatures, empty signatures
+        CScript scriptFewer = CScript() << OP_0;
+        for (int i = 1; i < nRequired; i++)
+            scriptFewer << vSigs[i];
+        CheckSpend(scriptFewer << vchRedeemScript, scriptPubKey, txSpend);
+
+        CScript scriptMore = CScript() << OP_0;
+        for (int i = 0; i <= nRequired; i++)
+            scriptMore << vSigs[i];
+        CheckSpend(scriptMore << vchRedeemScript, scriptPubKey, txSpend);
+
+        CScript scriptEmpty = CScript() << OP_0;
+        for (int i = 0; i < nRequired; i++)
+            scriptEmpty << OP_0;
+        CheckSpend(scriptEmpty << vchRedeemScript, scriptPubKey, txSpend);
+
+        // Non-null dummy, and a redeem script that doesn't match the hash
+        CScript scriptDummy = CScript() << OP_1;
+        CScript scriptDummyPush = CScript() << valtype(1, 0);
+        for (int i = 0; i < nRequired; i++) {
+            scriptDummy << vSigs[i];
+            scriptDummyPush << vSigs[i];
+        }
+        CheckSpend(scriptDummy << vchRedeemScript, scriptPubKey, txSpend);
+        CheckSpend(scriptDummyPush << vchRedeemScript, scriptPubKey, txSpend);
+
+        CScript scriptWrongRedeem = CScript() << OP_0;
+        for (int i = 0; i < nRequired; i++)
+            scriptWrongRedeem << vSigs[i];
+        valtype vchWrongRedeem(vchRedeemScript);
+        vchWrongRedeem[1] ^= 1;
+        CheckSpend(scriptWrongRedeem << vchWrongRedeem, scriptPubKey, txSpend);
+    }
+
+    BOOST_CHECK(nHandled > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -166,6 +166,32 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+// Goal: check that signature hashes computed from precomputed transaction
+// data are identical to the ones computed from scratch, for every input.
+BOOST_AUTO_TEST_CASE(sighash_precomputed_test)
+{
+    seed_insecure_rand(false);
+
+    for (int i=0; i<20000; i++) {
+        int nHashType = insecure_rand();
+        // Make sure the cached SIGHASH_ALL path is taken often
+        if (insecure_rand() % 2)
+            nHashType = SIGHASH_ALL;
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        const CTransaction tx(txTo);
+        PrecomputedTransactionData txdata(tx);
+
+        for (unsigned int nIn = 0; nIn <= tx.vin.size(); nIn++) {
+            uint256 sh = SignatureHash(scriptCode, tx, nIn, nHashType, &txdata);
+            BOOST_CHECK(sh == SignatureHash(scriptCode, tx, nIn, nHashType));
+            BOOST_CHECK(sh == SignatureHashOld(scriptCode, tx, nIn, nHashType));
+        }
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
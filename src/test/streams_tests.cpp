@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "streams.h"
 #include "support/allocators/zeroafterfree.h"
 #include "test/test_credits.h"
@@ -63,4 +64,29 @@ BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
             std::string(ds.begin(), ds.end()));  
 }         
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    CDataStream ds(SER_DISK, CLIENT_VERSION);
+    std::vector<unsigned char> vch;
+    vch += 1, 2, 3;
+    ds << (uint32_t)0x01020304 << std::string("credits") << vch << (uint8_t)7;
+
+    CSpanReader reader(&ds[0], &ds[0] + ds.size(), SER_DISK, CLIENT_VERSION);
+    uint32_t n;
+    std::string str;
+    std::vector<unsigned char> vchOut;
+    reader >> n >> str >> vchOut;
+    BOOST_CHECK_EQUAL(n, 0x01020304U);
+    BOOST_CHECK_EQUAL(str, "credits");
+    BOOST_CHECK(vchOut == vch);
+    BOOST_CHECK_EQUAL(reader.size(), 1U);
+
+    // Reading past the end throws and leaves the data untouched
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+    uint8_t c;
+    reader >> c;
+    BOOST_CHECK_EQUAL(c, 7);
+    BOOST_CHECK(reader.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -83,4 +83,46 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_mempool_script_execution_cache, TestChain100Setup)
+{
+    // Accepting a transaction to the memory pool verifies its scripts with the
+    // block script flags and caches the result, so checking it again with
+    // those flags must not produce any script checks, while other flags
+    // still do.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    LOCK(cs_main);
+    const CTransaction tx(spend);
+    unsigned int flags = GetBlockScriptFlags(chainActive.Tip());
+    CValidationState state;
+    std::vector<CScriptCheck> vChecks;
+
+    BOOST_CHECK(CheckInputs(tx, state, *pcoinsTip, true, flags, true, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    BOOST_CHECK(ToMemPool(spend));
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, *pcoinsTip, true, flags, true, false, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, *pcoinsTip, true, flags & ~SCRIPT_VERIFY_DERSIG, true, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,8 +7,10 @@
 
 #include "txdb.h"
 
+#include "blockfilter.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "compressor.h"
 #include "hash.h"
 #include "main.h"
 #include "pow.h"
@@ -25,6 +27,12 @@ static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSINDEX_COMPACT = 'A';
+static const char DB_ADDRESSUNSPENTINDEX_COMPACT = 'U';
+static const char DB_TXNUM = 'N';
+static const char DB_TXNUM_BY_HASH = 'n';
+static const char DB_BLOCKFILTERINDEX = 'g';
+static const char DB_BLOCKFILTERINDEX_BEST = 'G';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -75,7 +83,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe), fCompactAddressIndex(false) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -171,6 +179,14 @@ bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     return Read(std::make_pair(DB_SPENTINDEX, key), value);
 }
 
+size_t CBlockTreeDB::ReadSpentIndex(const std::vector<CSpentIndexKey> &keys, std::vector<CSpentIndexValue> &values, std::vector<bool> &vFound) {
+    std::vector<std::pair<char, CSpentIndexKey> > dbkeys;
+    dbkeys.reserve(keys.size());
+    for (std::vector<CSpentIndexKey>::const_iterator it = keys.begin(); it != keys.end(); it++)
+        dbkeys.push_back(std::make_pair(DB_SPENTINDEX, *it));
+    return ReadMany(dbkeys, values, vFound);
+}
+
 bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
     CDBBatch batch(&GetObfuscateKey());
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
@@ -183,15 +199,329 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(&GetObfuscateKey());
+namespace {
+
+/**
+ * Variable-length unsigned integer whose encoding sorts like its value: a
+ * length byte followed by the minimal big-endian representation. Unlike
+ * VARINT this keeps LevelDB key order equal to numeric order.
+ */
+template<typename I>
+class CSortableVarInt
+{
+protected:
+    I &n;
+public:
+    CSortableVarInt(I& nIn) : n(nIn) { }
+
+    unsigned int GetSerializeSize(int, int) const {
+        unsigned int nBytes = 0;
+        for (uint64_t v = n; v != 0; v >>= 8)
+            nBytes++;
+        return 1 + nBytes;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const {
+        unsigned int nBytes = GetSerializeSize(nType, nVersion) - 1;
+        ser_writedata8(s, nBytes);
+        for (int i = nBytes - 1; i >= 0; i--)
+            ser_writedata8(s, (uint64_t)n >> (8 * i));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int, int) {
+        unsigned int nBytes = ser_readdata8(s);
+        if (nBytes > sizeof(I))
+            throw std::ios_base::failure("Sortable varint too large");
+        uint64_t v = 0;
+        for (unsigned int i = 0; i < nBytes; i++)
+            v = (v << 8) | ser_readdata8(s);
+        n = v;
+    }
+};
+
+template<typename I>
+CSortableVarInt<I> WrapSortableVarInt(I& n) { return CSortableVarInt<I>(n); }
+
+#define SORTABLE_VARINT(obj) REF(WrapSortableVarInt(REF(obj)))
+
+/** Dense transaction number used by the compact address index: block height and position in the block. */
+struct CTxNumber {
+    int blockHeight;
+    unsigned int txindex;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 4 + SORTABLE_VARINT(txindex).GetSerializeSize(nType, nVersion);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        // Heights are stored big-endian for key sorting in LevelDB
+        ser_writedata32be(s, blockHeight);
+        SORTABLE_VARINT(txindex).Serialize(s, nType, nVersion);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        blockHeight = ser_readdata32be(s);
+        SORTABLE_VARINT(txindex).Unserialize(s, nType, nVersion);
+    }
+
+    CTxNumber(int height, unsigned int blockindex) {
+        blockHeight = height;
+        txindex = blockindex;
+    }
+
+    CTxNumber() {
+        blockHeight = 0;
+        txindex = 0;
+    }
+
+    bool operator<(const CTxNumber& other) const {
+        if (blockHeight != other.blockHeight)
+            return blockHeight < other.blockHeight;
+        return txindex < other.txindex;
+    }
+};
+
+/** CAddressIndexKey without the txid, which is recovered through the tx number table. */
+struct CCompactAddressIndexKey {
+    unsigned int type;
+    uint160 hashBytes;
+    CTxNumber txnum;
+    unsigned int index;
+    bool spending;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 22 + txnum.GetSerializeSize(nType, nVersion) + SORTABLE_VARINT(index).GetSerializeSize(nType, nVersion);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        txnum.Serialize(s, nType, nVersion);
+        SORTABLE_VARINT(index).Serialize(s, nType, nVersion);
+        char f = spending;
+        ser_writedata8(s, f);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        txnum.Unserialize(s, nType, nVersion);
+        SORTABLE_VARINT(index).Unserialize(s, nType, nVersion);
+        char f = ser_readdata8(s);
+        spending = f;
+    }
+
+    CCompactAddressIndexKey(const CAddressIndexKey& key) : txnum(key.blockHeight, key.txindex) {
+        type = key.type;
+        hashBytes = key.hashBytes;
+        index = key.index;
+        spending = key.spending;
+    }
+
+    CCompactAddressIndexKey() {
+        type = 0;
+        hashBytes.SetNull();
+        index = 0;
+        spending = false;
+    }
+};
+
+/** CAddressUnspentKey with the txid replaced by its tx number. */
+struct CCompactAddressUnspentKey {
+    unsigned int type;
+    uint160 hashBytes;
+    CTxNumber txnum;
+    unsigned int index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 21 + txnum.GetSerializeSize(nType, nVersion) + SORTABLE_VARINT(index).GetSerializeSize(nType, nVersion);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        txnum.Serialize(s, nType, nVersion);
+        SORTABLE_VARINT(index).Serialize(s, nType, nVersion);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        txnum.Unserialize(s, nType, nVersion);
+        SORTABLE_VARINT(index).Unserialize(s, nType, nVersion);
+    }
+
+    CCompactAddressUnspentKey(const CAddressUnspentKey& key, const CTxNumber& txnumIn) : txnum(txnumIn) {
+        type = key.type;
+        hashBytes = key.hashBytes;
+        index = key.index;
+    }
+
+    CCompactAddressUnspentKey() {
+        type = 0;
+        hashBytes.SetNull();
+        index = 0;
+    }
+};
+
+/** Wrapper for CAddressUnspentValue that stores the height as a VARINT and the output compressed. */
+class CCompactAddressUnspentValue
+{
+private:
+    CAddressUnspentValue &value;
+
+public:
+    CCompactAddressUnspentValue(CAddressUnspentValue &valueIn) : value(valueIn) { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(VARINT(value.blockHeight));
+        CTxOut txout(value.satoshis, value.script);
+        READWRITE(REF(CTxOutCompressor(txout)));
+        if (ser_action.ForRead()) {
+            value.satoshis = txout.nValue;
+            value.script = txout.scriptPubKey;
+        }
+    }
+};
+
+/** Maps signed amounts onto unsigned integers so that small magnitudes get short VARINTs. */
+uint64_t ZigZagEncode(CAmount n) { return ((uint64_t)n << 1) ^ (uint64_t)(n >> 63); }
+CAmount ZigZagDecode(uint64_t n) { return (CAmount)(n >> 1) ^ -(CAmount)(n & 1); }
+
+} // namespace
+
+bool CBlockTreeDB::ReadTxNumberHash(int nHeight, unsigned int nTxIndex, uint256 &txhash) {
+    return Read(std::make_pair(DB_TXNUM, CTxNumber(nHeight, nTxIndex)), txhash);
+}
+
+bool CBlockTreeDB::ReadAddressIndexEntry(CDBIterator *pcursor, std::pair<CAddressIndexKey, CAmount> &entry, bool &fError) {
+    if (!pcursor->Valid())
+        return false;
+    if (!fCompactAddressIndex) {
+        std::pair<char,CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX)
+            return false;
+        if (!pcursor->GetValue(entry.second)) {
+            fError = true;
+            return false;
+        }
+        entry.first = key.second;
+        return true;
+    }
+
+    std::pair<char,CCompactAddressIndexKey> key;
+    if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX_COMPACT)
+        return false;
+    uint64_t nValue = 0;
+    CVarInt<uint64_t> value(nValue);
+    if (!pcursor->GetValue(value)) {
+        fError = true;
+        return false;
+    }
+    // Consecutive entries usually belong to the same transaction, so only
+    // look the txid up when the tx number changes.
+    uint256 txhash = entry.first.txhash;
+    if (txhash.IsNull() || entry.first.blockHeight != key.second.txnum.blockHeight || entry.first.txindex != key.second.txnum.txindex) {
+        if (!ReadTxNumberHash(key.second.txnum.blockHeight, key.second.txnum.txindex, txhash)) {
+            fError = true;
+            return false;
+        }
+    }
+    entry.first = CAddressIndexKey(key.second.type, key.second.hashBytes, key.second.txnum.blockHeight, key.second.txnum.txindex,
+                                   txhash, key.second.index, key.second.spending);
+    entry.second = ZigZagDecode(nValue);
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentEntry(CDBIterator *pcursor, std::pair<CAddressUnspentKey, CAddressUnspentValue> &entry, bool &fError) {
+    if (!pcursor->Valid())
+        return false;
+    if (!fCompactAddressIndex) {
+        std::pair<char,CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTINDEX)
+            return false;
+        if (!pcursor->GetValue(entry.second)) {
+            fError = true;
+            return false;
+        }
+        entry.first = key.second;
+        return true;
+    }
+
+    std::pair<char,CCompactAddressUnspentKey> key;
+    if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTINDEX_COMPACT)
+        return false;
+    CCompactAddressUnspentValue value(entry.second);
+    uint256 txhash;
+    if (!pcursor->GetValue(value) || !ReadTxNumberHash(key.second.txnum.blockHeight, key.second.txnum.txindex, txhash)) {
+        fError = true;
+        return false;
+    }
+    entry.first = CAddressUnspentKey(key.second.type, key.second.hashBytes, txhash, key.second.index);
+    return true;
+}
+
+void CBlockTreeDB::WriteAddressIndexEntries(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fCompact) {
+    if (!fCompact) {
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+            batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+        return;
+    }
+
+    std::set<CTxNumber> setTxNumbers;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        CCompactAddressIndexKey key(it->first);
+        uint64_t nValue = ZigZagEncode(it->second);
+        batch.Write(std::make_pair(DB_ADDRESSINDEX_COMPACT, key), VARINT(nValue));
+        if (setTxNumbers.insert(key.txnum).second) {
+            batch.Write(std::make_pair(DB_TXNUM, key.txnum), it->first.txhash);
+            batch.Write(std::make_pair(DB_TXNUM_BY_HASH, it->first.txhash), key.txnum);
+        }
+    }
+}
+
+bool CBlockTreeDB::WriteAddressUnspentEntries(CDBBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect, bool fCompact) {
+    std::map<uint256, CTxNumber> mapTxNumbers;
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (!fCompact) {
+            if (it->second.IsNull()) {
+                batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+            } else {
+                batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+            }
+            continue;
+        }
+
+        // The creating transaction's address index entries are always
+        // written before its outputs enter the unspent index, so its tx
+        // number is known here.
+        std::map<uint256, CTxNumber>::iterator mi = mapTxNumbers.find(it->first.txhash);
+        if (mi == mapTxNumbers.end()) {
+            CTxNumber txnum;
+            if (!Read(std::make_pair(DB_TXNUM_BY_HASH, it->first.txhash), txnum))
+                return error("%s: no tx number for %s", __func__, it->first.txhash.ToString());
+            mi = mapTxNumbers.insert(std::make_pair(it->first.txhash, txnum)).first;
+        }
+        CCompactAddressUnspentKey key(it->first, mi->second);
         if (it->second.IsNull()) {
-            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX_COMPACT, key));
         } else {
-            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+            CAddressUnspentValue value = it->second;
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX_COMPACT, key), CCompactAddressUnspentValue(value));
         }
     }
+    return true;
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+    CDBBatch batch(&GetObfuscateKey());
+    if (!WriteAddressUnspentEntries(batch, vect, fCompactAddressIndex))
+        return false;
     return WriteBatch(batch);
 }
 
@@ -200,72 +530,256 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    pcursor->Seek(std::make_pair(fCompactAddressIndex ? DB_ADDRESSUNSPENTINDEX_COMPACT : DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
 
-    while (pcursor->Valid()) {
+    std::pair<CAddressUnspentKey, CAddressUnspentValue> entry;
+    bool fError = false;
+    while (ReadAddressUnspentEntry(pcursor.get(), entry, fError) && entry.first.hashBytes == addressHash) {
         boost::this_thread::interruption_point();
-        std::pair<char,CAddressUnspentKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
-            CAddressUnspentValue nValue;
-            if (pcursor->GetValue(nValue)) {
-                unspentOutputs.push_back(std::make_pair(key.second, nValue));
-                pcursor->Next();
-            } else {
-                return error("failed to get address unspent value");
-            }
-        } else {
-            break;
-        }
+        unspentOutputs.push_back(entry);
+        pcursor->Next();
     }
+    if (fError)
+        return error("failed to get address unspent value");
 
     return true;
 }
 
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(&GetObfuscateKey());
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    WriteAddressIndexEntries(batch, vect, fCompactAddressIndex);
     return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(&GetObfuscateKey());
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+    // Tx numbers are left in place: the unspent index entries of a
+    // disconnected block are erased after this and still need them. See
+    // EraseAddressTxNumbers.
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (fCompactAddressIndex)
+            batch.Erase(std::make_pair(DB_ADDRESSINDEX_COMPACT, CCompactAddressIndexKey(it->first)));
+        else
+            batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressTxNumbers(const std::vector<std::pair<CAddressIndexKey, CAmount> >&vect) {
+    if (!fCompactAddressIndex)
+        return true;
+
+    CDBBatch batch(&GetObfuscateKey());
+    std::set<CTxNumber> setTxNumbers;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        CCompactAddressIndexKey key(it->first);
+        if (setTxNumbers.insert(key.txnum).second) {
+            batch.Erase(std::make_pair(DB_TXNUM, key.txnum));
+            batch.Erase(std::make_pair(DB_TXNUM_BY_HASH, it->first.txhash));
+        }
+    }
     return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
+    std::vector<std::pair<uint160, int> > addresses(1, std::make_pair(addressHash, type));
+    return ReadAddressIndex(addresses, addressIndex, start, end);
+}
 
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+namespace {
+
+/** Orders cursors by the (height, txindex) of their current entry; the heap top is the smallest. */
+struct CompareAddressIndexHead
+{
+    const std::vector<std::pair<CAddressIndexKey, CAmount> > &heads;
+
+    CompareAddressIndexHead(const std::vector<std::pair<CAddressIndexKey, CAmount> > &headsIn) : heads(headsIn) {}
+
+    bool operator()(size_t a, size_t b) const
+    {
+        const CAddressIndexKey &keyA = heads[a].first;
+        const CAddressIndexKey &keyB = heads[b].first;
+        if (keyA.blockHeight != keyB.blockHeight)
+            return keyA.blockHeight > keyB.blockHeight;
+        if (keyA.txindex != keyB.txindex)
+            return keyA.txindex > keyB.txindex;
+        return a > b;
+    }
+};
+
+} // namespace
+
+bool CBlockTreeDB::ReadAddressIndexHead(CDBIterator *pcursor, const uint160 &addressHash, int end,
+                                        std::pair<CAddressIndexKey, CAmount> &head, bool &fError) {
+    if (!ReadAddressIndexEntry(pcursor, head, fError) || head.first.hashBytes != addressHash)
+        return false;
+    return end <= 0 || head.first.blockHeight <= end;
+}
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+bool CBlockTreeDB::ReadAddressIndex(const std::vector<std::pair<uint160, int> > &addresses,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                    int start, int end, unsigned int nMaxTxs) {
+
+    // Every address' entries are already stored in (height, txindex) order, so
+    // merge one cursor per address instead of reading and sorting everything.
+    const char prefix = fCompactAddressIndex ? DB_ADDRESSINDEX_COMPACT : DB_ADDRESSINDEX;
+    std::vector<std::unique_ptr<CDBIterator> > cursors;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > heads(addresses.size());
+    std::vector<size_t> heap;
+    CompareAddressIndexHead comp(heads);
+    bool fError = false;
+
+    cursors.reserve(addresses.size());
+    for (size_t i = 0; i < addresses.size(); i++) {
+        cursors.emplace_back(NewIterator());
+        if (start > 0 && end > 0) {
+            cursors[i]->Seek(std::make_pair(prefix, CAddressIndexIteratorHeightKey(addresses[i].second, addresses[i].first, start)));
+        } else {
+            cursors[i]->Seek(std::make_pair(prefix, CAddressIndexIteratorKey(addresses[i].second, addresses[i].first)));
+        }
+        if (ReadAddressIndexHead(cursors[i].get(), addresses[i].first, end, heads[i], fError))
+            heap.push_back(i);
+        if (fError)
+            return error("failed to get address index value");
     }
+    std::make_heap(heap.begin(), heap.end(), comp);
 
-    while (pcursor->Valid()) {
+    unsigned int nTxs = 0;
+    int nLastHeight = -1;
+    unsigned int nLastTxIndex = 0;
+    while (!heap.empty()) {
         boost::this_thread::interruption_point();
-        std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
-            if (end > 0 && key.second.blockHeight > end) {
+        std::pop_heap(heap.begin(), heap.end(), comp);
+        size_t i = heap.back();
+        heap.pop_back();
+
+        const CAddressIndexKey &key = heads[i].first;
+        if (key.blockHeight != nLastHeight || key.txindex != nLastTxIndex) {
+            if (nMaxTxs > 0 && nTxs == nMaxTxs)
                 break;
+            nTxs++;
+            nLastHeight = key.blockHeight;
+            nLastTxIndex = key.txindex;
+        }
+        addressIndex.push_back(heads[i]);
+
+        cursors[i]->Next();
+        if (ReadAddressIndexHead(cursors[i].get(), addresses[i].first, end, heads[i], fError)) {
+            heap.push_back(i);
+            std::push_heap(heap.begin(), heap.end(), comp);
+        }
+        if (fError)
+            return error("failed to get address index value");
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ConvertAddressIndex(bool fCompact) {
+    if (fCompact == fCompactAddressIndex)
+        return true;
+
+    LogPrintf("Converting address index to the %s format...\n", fCompact ? "compact" : "legacy");
+
+    // Entries are moved in bounded batches, each erasing the old-format keys
+    // it rewrites. An interrupted conversion leaves the format flag
+    // untouched and simply resumes with the remaining entries next time.
+    static const size_t nBatchEntries = 10000;
+    size_t nConverted = 0;
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(fCompactAddressIndex ? DB_ADDRESSINDEX_COMPACT : DB_ADDRESSINDEX);
+    std::pair<CAddressIndexKey, CAmount> entry;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > entries;
+    bool fError = false;
+    bool fMore = true;
+    while (fMore) {
+        boost::this_thread::interruption_point();
+        fMore = ReadAddressIndexEntry(pcursor.get(), entry, fError);
+        if (fMore) {
+            entries.push_back(entry);
+            pcursor->Next();
+        }
+        if (entries.size() == nBatchEntries || (!fMore && !entries.empty())) {
+            CDBBatch batch(&GetObfuscateKey());
+            WriteAddressIndexEntries(batch, entries, fCompact);
+            for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=entries.begin(); it!=entries.end(); it++) {
+                if (fCompact)
+                    batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+                else
+                    batch.Erase(std::make_pair(DB_ADDRESSINDEX_COMPACT, CCompactAddressIndexKey(it->first)));
             }
-            CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(std::make_pair(key.second, nValue));
+            if (!WriteBatch(batch))
+                return false;
+            nConverted += entries.size();
+            entries.clear();
+        }
+    }
+    if (fError)
+        return error("%s: failed to read address index entry", __func__);
+
+    pcursor.reset(NewIterator());
+    pcursor->Seek(fCompactAddressIndex ? DB_ADDRESSUNSPENTINDEX_COMPACT : DB_ADDRESSUNSPENTINDEX);
+    std::pair<CAddressUnspentKey, CAddressUnspentValue> unspent;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspents;
+    fMore = true;
+    while (fMore) {
+        boost::this_thread::interruption_point();
+        fMore = ReadAddressUnspentEntry(pcursor.get(), unspent, fError);
+        if (fMore) {
+            unspents.push_back(unspent);
+            pcursor->Next();
+        }
+        if (unspents.size() == nBatchEntries || (!fMore && !unspents.empty())) {
+            CDBBatch batch(&GetObfuscateKey());
+            // Erase in the old format first: both formats resolve tx numbers
+            // through the same table, so the old keys are computed the same way.
+            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > erased;
+            for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspents.begin(); it!=unspents.end(); it++)
+                erased.push_back(std::make_pair(it->first, CAddressUnspentValue()));
+            if (!WriteAddressUnspentEntries(batch, erased, fCompactAddressIndex) ||
+                !WriteAddressUnspentEntries(batch, unspents, fCompact) ||
+                !WriteBatch(batch))
+                return false;
+            nConverted += unspents.size();
+            unspents.clear();
+        }
+    }
+    if (fError)
+        return error("%s: failed to read address unspent entry", __func__);
+
+    if (!fCompact) {
+        // The tx number table is only used by the compact format.
+        CDBBatch batch(&GetObfuscateKey());
+        const char prefixes[] = {DB_TXNUM, DB_TXNUM_BY_HASH};
+        for (unsigned int i = 0; i < sizeof(prefixes); i++) {
+            pcursor.reset(NewIterator());
+            pcursor->Seek(prefixes[i]);
+            while (pcursor->Valid()) {
+                boost::this_thread::interruption_point();
+                std::pair<char, CTxNumber> numKey;
+                std::pair<char, uint256> hashKey;
+                if (prefixes[i] == DB_TXNUM && pcursor->GetKey(numKey) && numKey.first == DB_TXNUM) {
+                    batch.Erase(numKey);
+                } else if (prefixes[i] == DB_TXNUM_BY_HASH && pcursor->GetKey(hashKey) && hashKey.first == DB_TXNUM_BY_HASH) {
+                    batch.Erase(hashKey);
+                } else {
+                    break;
+                }
                 pcursor->Next();
-            } else {
-                return error("failed to get address index value");
             }
-        } else {
-            break;
         }
+        if (!WriteBatch(batch))
+            return false;
     }
 
+    fCompactAddressIndex = fCompact;
+    if (!WriteFlag("compactaddressindex", fCompact))
+        return false;
+
+    LogPrintf("Converted %u address index entries\n", (unsigned int)nConverted);
     return true;
 }
 
@@ -275,6 +789,25 @@ bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex)
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteBlockFilterIndex(const uint256 &hashBlock, const CBlockFilterIndexEntry &entry) {
+    CDBBatch batch(&GetObfuscateKey());
+    batch.Write(std::make_pair(DB_BLOCKFILTERINDEX, hashBlock), entry);
+    batch.Write(DB_BLOCKFILTERINDEX_BEST, hashBlock);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadBlockFilterIndexBest(uint256 &hashBlock) {
+    return Read(DB_BLOCKFILTERINDEX_BEST, hashBlock);
+}
+
+bool CBlockTreeDB::ReadBlockFilterIndex(const uint256 &hashBlock, CBlockFilterIndexEntry &entry) {
+    return Read(std::make_pair(DB_BLOCKFILTERINDEX, hashBlock), entry);
+}
+
+bool CBlockTreeDB::HaveBlockFilterIndex(const uint256 &hashBlock) {
+    return Exists(std::make_pair(DB_BLOCKFILTERINDEX, hashBlock));
+}
+
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
@@ -25,6 +25,7 @@ struct CAddressIndexIteratorHeightKey;
 struct CAddressIndexKey;
 struct CAddressUnspentKey;
 struct CAddressUnspentValue;
+struct CBlockFilterIndexEntry;
 struct CDiskTxPos;
 struct CTimestampIndexIteratorKey;
 struct CTimestampIndexKey;
@@ -69,6 +70,17 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    //! Whether the address indexes use the compact (tx number based) format
+    bool fCompactAddressIndex;
+
+    bool ReadTxNumberHash(int nHeight, unsigned int nTxIndex, uint256 &txhash);
+    bool ReadAddressIndexEntry(CDBIterator *pcursor, std::pair<CAddressIndexKey, CAmount> &entry, bool &fError);
+    bool ReadAddressIndexHead(CDBIterator *pcursor, const uint160 &addressHash, int end,
+                              std::pair<CAddressIndexKey, CAmount> &head, bool &fError);
+    bool ReadAddressUnspentEntry(CDBIterator *pcursor, std::pair<CAddressUnspentKey, CAddressUnspentValue> &entry, bool &fError);
+    void WriteAddressIndexEntries(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fCompact);
+    bool WriteAddressUnspentEntries(CDBBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect, bool fCompact);
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
@@ -78,17 +90,33 @@ public:
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+    size_t ReadSpentIndex(const std::vector<CSpentIndexKey> &keys, std::vector<CSpentIndexValue> &values, std::vector<bool> &vFound);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    /** Erase the tx numbers of the transactions of address index entries, once the entries are gone. */
+    bool EraseAddressTxNumbers(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    bool ReadAddressIndex(const std::vector<std::pair<uint160, int> > &addresses,
+                          std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                          int start = 0, int end = 0, unsigned int nMaxTxs = 0);
+    void SetCompactAddressIndex(bool fCompact) { fCompactAddressIndex = fCompact; }
+    bool IsCompactAddressIndex() const { return fCompactAddressIndex; }
+    /** Rewrite the address and address unspent indexes in the given format and record it. */
+    bool ConvertAddressIndex(bool fCompact);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
+    /** Write a block's filter entry and record the block as the last one indexed. */
+    bool WriteBlockFilterIndex(const uint256 &hashBlock, const CBlockFilterIndexEntry &entry);
+    /** Read the last block indexed. It and all its ancestors have an entry. */
+    bool ReadBlockFilterIndexBest(uint256 &hashBlock);
+    bool ReadBlockFilterIndex(const uint256 &hashBlock, CBlockFilterIndexEntry &entry);
+    bool HaveBlockFilterIndex(const uint256 &hashBlock);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
@@ -201,6 +201,75 @@ void CWallet::DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, u
         throw std::runtime_error(std::string(__func__) + ": AddHDPubKey failed");
 }
 
+void CWallet::DeriveNewChildKeys(CWalletDB& walletdb, const CKeyMetadata& metadata, uint32_t nAccountIndex, bool fInternal, unsigned int nCount, std::vector<CPubKey>& vPubKeysRet)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+
+    CHDChain hdChainTmp;
+    if (!GetHDChain(hdChainTmp)) {
+        throw std::runtime_error(std::string(__func__) + ": GetHDChain failed");
+    }
+
+    if (!DecryptHDChain(hdChainTmp))
+        throw std::runtime_error(std::string(__func__) + ": DecryptHDChainSeed failed");
+    // make sure seed matches this chain
+    if (hdChainTmp.GetID() != hdChainTmp.GetSeedHash())
+        throw std::runtime_error(std::string(__func__) + ": Wrong HD chain!");
+
+    CHDAccount acc;
+    if (!hdChainTmp.GetAccount(nAccountIndex, acc))
+        throw std::runtime_error(std::string(__func__) + ": Wrong HD account!");
+
+    // derive child keys from the next index on, on all cores, skip keys already known to the wallet
+    std::vector<CExtPubKey> vExtPubKeys;
+    uint32_t nChildIndex = fInternal ? acc.nInternalChainCounter : acc.nExternalChainCounter;
+    while (vExtPubKeys.size() < nCount) {
+        std::vector<CExtPubKey> vDerived;
+        hdChainTmp.DeriveChildExtPubKeys(nAccountIndex, fInternal, nChildIndex, nCount - vExtPubKeys.size(), vDerived, GetNumCores());
+        nChildIndex += vDerived.size();
+        BOOST_FOREACH(const CExtPubKey& extPubKey, vDerived) {
+            if (!HaveKey(extPubKey.pubkey.GetID()))
+                vExtPubKeys.push_back(extPubKey);
+        }
+    }
+
+    // store metadata
+    BOOST_FOREACH(const CExtPubKey& extPubKey, vExtPubKeys)
+        mapKeyMetadata[extPubKey.pubkey.GetID()] = metadata;
+    if (!nTimeFirstKey || metadata.nCreateTime < nTimeFirstKey)
+        nTimeFirstKey = metadata.nCreateTime;
+
+    // update the chain model in the database, once for all keys
+    CHDChain hdChainCurrent;
+    GetHDChain(hdChainCurrent);
+
+    if (fInternal) {
+        acc.nInternalChainCounter = nChildIndex;
+    }
+    else {
+        acc.nExternalChainCounter = nChildIndex;
+    }
+
+    if (!hdChainCurrent.SetAccount(nAccountIndex, acc))
+        throw std::runtime_error(std::string(__func__) + ": SetAccount failed");
+
+    if (IsCrypted()) {
+        if (!SetCryptedHDChain(hdChainCurrent, true) || !walletdb.WriteCryptedHDChain(hdChainCurrent))
+            throw std::runtime_error(std::string(__func__) + ": SetCryptedHDChain failed");
+    }
+    else {
+        if (!SetHDChain(hdChainCurrent, true) || !walletdb.WriteHDChain(hdChainCurrent))
+            throw std::runtime_error(std::string(__func__) + ": SetHDChain failed");
+    }
+
+    vPubKeysRet.clear();
+    BOOST_FOREACH(const CExtPubKey& extPubKey, vExtPubKeys) {
+        if (!AddHDPubKeyWithDB(walletdb, extPubKey, fInternal))
+            throw std::runtime_error(std::string(__func__) + ": AddHDPubKey failed");
+        vPubKeysRet.push_back(extPubKey.pubkey);
+    }
+}
+
 bool CWallet::GetPubKey(const CKeyID &address, CPubKey& vchPubKeyOut) const
 {
     LOCK(cs_wallet);
@@ -260,6 +329,12 @@ bool CWallet::LoadHDPubKey(const CHDPubKey &hdPubKey)
 }
 
 bool CWallet::AddHDPubKey(const CExtPubKey &extPubKey, bool fInternal)
+{
+    CWalletDB walletdb(strWalletFile);
+    return AddHDPubKeyWithDB(walletdb, extPubKey, fInternal);
+}
+
+bool CWallet::AddHDPubKeyWithDB(CWalletDB &walletdb, const CExtPubKey &extPubKey, bool fInternal)
 {
     AssertLockHeld(cs_wallet);
 
@@ -276,15 +351,15 @@ bool CWallet::AddHDPubKey(const CExtPubKey &extPubKey, bool fInternal)
     CScript script;
     script = GetScriptForDestination(extPubKey.pubkey.GetID());
     if (HaveWatchOnly(script))
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     script = GetScriptForRawPubKey(extPubKey.pubkey);
     if (HaveWatchOnly(script))
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
 
     if (!fFileBacked)
         return true;
 
-    return CWalletDB(strWalletFile).WriteHDPubKey(hdPubKey, mapKeyMetadata[extPubKey.pubkey.GetID()]);
+    return walletdb.WriteHDPubKey(hdPubKey, mapKeyMetadata[extPubKey.pubkey.GetID()]);
 }
 
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
@@ -385,6 +460,12 @@ bool CWallet::AddWatchOnly(const CScript &dest)
 }
 
 bool CWallet::RemoveWatchOnly(const CScript &dest)
+{
+    CWalletDB walletdb(strWalletFile);
+    return RemoveWatchOnlyWithDB(walletdb, dest);
+}
+
+bool CWallet::RemoveWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest)
 {
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
@@ -392,7 +473,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
-        if (!CWalletDB(strWalletFile).EraseWatchOnly(dest))
+        if (!walletdb.EraseWatchOnly(dest))
             return false;
 
     return true;
@@ -2026,11 +2107,7 @@ CAmount CWalletTx::GetChange() const
 
 bool CWalletTx::InMempool() const
 {
-    LOCK(mempool.cs);
-    if (mempool.exists(GetHash())) {
-        return true;
-    }
-    return false;
+    return mempool.exists(GetHash());
 }
 
 bool CWalletTx::IsTrusted() const
@@ -3460,24 +3537,30 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                 }
 
                 // Sign
-                int nIn = 0;
-                CTransaction txNewConst(txNew);
-                BOOST_FOREACH(const CTxIn& txin, txNew.vin)
+                if (sign)
                 {
-                    bool signSuccess;
-                    const CScript& scriptPubKey = txin.prevPubKey;
-                    CScript& scriptSigRes = txNew.vin[nIn].scriptSig;
-                    if (sign)
-                        signSuccess = ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, SIGHASH_ALL), scriptPubKey, scriptSigRes);
-                    else
-                        signSuccess = ProduceSignature(DummySignatureCreator(this), scriptPubKey, scriptSigRes);
+                    // Large transactions are signed on all cores at once
+                    std::vector<std::pair<unsigned int, CScript> > vInputs;
+                    vInputs.reserve(txNew.vin.size());
+                    for (unsigned int nIn = 0; nIn < txNew.vin.size(); nIn++)
+                        vInputs.push_back(std::make_pair(nIn, txNew.vin[nIn].prevPubKey));
 
-                    if (!signSuccess)
+                    if (!SignSignatures(*this, txNew, vInputs, SIGHASH_ALL, GetNumCores()))
                     {
                         strFailReason = _("Signing transaction failed");
                         return false;
                     }
-                    nIn++;
+                }
+                else
+                {
+                    BOOST_FOREACH(CTxIn& txin, txNew.vin)
+                    {
+                        if (!ProduceSignature(DummySignatureCreator(this), txin.prevPubKey, txin.scriptSig))
+                        {
+                            strFailReason = _("Signing transaction failed");
+                            return false;
+                        }
+                    }
                 }
 
                 unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
@@ -3826,33 +3909,81 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         }
         bool fInternal = false;
         CWalletDB walletdb(strWalletFile);
-        for (int64_t i = missingInternal + missingExternal; i--;)
+        if (IsHDEnabled())
         {
+            // Derive the missing keys in batches, external ones first like
+            // below, and write each batch in one database transaction
             int64_t nEnd = 1;
-            if (i < missingInternal) {
-                fInternal = true;
-            }
             if (!setInternalKeyPool.empty()) {
                 nEnd = *(--setInternalKeyPool.end()) + 1;
             }
             if (!setExternalKeyPool.empty()) {
                 nEnd = std::max(nEnd, *(--setExternalKeyPool.end()) + 1);
             }
-            // TODO: implement keypools for all accounts?
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey(0, fInternal), fInternal)))
-                throw std::runtime_error("TopUpKeyPool(): writing generated key failed");
+            int64_t nMissing = missingInternal + missingExternal;
+            bool fShowProgress = nMissing > (int64_t)KEYPOOL_BATCH_SIZE;
+            if (fShowProgress)
+                ShowProgress(_("Filling keypool..."), 0); // show progress dialog in GUI
+            for (int64_t nAdded = 0; nAdded < nMissing;)
+            {
+                fInternal = nAdded >= missingExternal;
+                int64_t nBatch = std::min((int64_t)KEYPOOL_BATCH_SIZE, (fInternal ? nMissing : missingExternal) - nAdded);
+                std::set<int64_t>& setKeyPool = fInternal ? setInternalKeyPool : setExternalKeyPool;
+
+                if (!walletdb.TxnBegin())
+                    throw std::runtime_error("TopUpKeyPool(): starting database transaction failed");
+                // TODO: implement keypools for all accounts?
+                std::vector<CPubKey> vPubKeys;
+                DeriveNewChildKeys(walletdb, CKeyMetadata(GetTime()), 0, fInternal, nBatch, vPubKeys);
+                BOOST_FOREACH(const CPubKey& pubkey, vPubKeys) {
+                    if (!walletdb.WritePool(nEnd, CKeyPool(pubkey, fInternal)))
+                        throw std::runtime_error("TopUpKeyPool(): writing generated key failed");
+                    setKeyPool.insert(nEnd++);
+                }
+                if (!walletdb.TxnCommit())
+                    throw std::runtime_error("TopUpKeyPool(): committing generated keys failed");
+                nAdded += nBatch;
+                LogPrintf("keypool added %d keys up to key %d, size=%u, internal=%d\n", nBatch, nEnd - 1, setInternalKeyPool.size() + setExternalKeyPool.size(), fInternal);
+
+                double dProgress = 100.f * (nEnd - 1) / (nTargetSize + 1);
+                std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
+                uiInterface.InitMessage(strMsg);
+                if (fShowProgress)
+                    ShowProgress(_("Filling keypool..."), std::max(1, std::min(99, (int)(nAdded * 100 / nMissing))));
+            }
+            if (fShowProgress)
+                ShowProgress(_("Filling keypool..."), 100); // hide progress dialog in GUI
+        }
+        else
+        {
+            for (int64_t i = missingInternal + missingExternal; i--;)
+            {
+                int64_t nEnd = 1;
+                if (i < missingInternal) {
+                    fInternal = true;
+                }
+                if (!setInternalKeyPool.empty()) {
+                    nEnd = *(--setInternalKeyPool.end()) + 1;
+                }
+                if (!setExternalKeyPool.empty()) {
+                    nEnd = std::max(nEnd, *(--setExternalKeyPool.end()) + 1);
+                }
+                // TODO: implement keypools for all accounts?
+                if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey(0, fInternal), fInternal)))
+                    throw std::runtime_error("TopUpKeyPool(): writing generated key failed");
 
-            if (fInternal) {
+                if (fInternal) {
 
-                setInternalKeyPool.insert(nEnd);
-            } else {
-                setExternalKeyPool.insert(nEnd);
-            }
-            LogPrintf("keypool added key %d, size=%u, internal=%d\n", nEnd, setInternalKeyPool.size() + setExternalKeyPool.size(), fInternal);
+                    setInternalKeyPool.insert(nEnd);
+                } else {
+                    setExternalKeyPool.insert(nEnd);
+                }
+                LogPrintf("keypool added key %d, size=%u, internal=%d\n", nEnd, setInternalKeyPool.size() + setExternalKeyPool.size(), fInternal);
 
-            double dProgress = 100.f * nEnd / (nTargetSize + 1);
-            std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
-            uiInterface.InitMessage(strMsg);
+                double dProgress = 100.f * nEnd / (nTargetSize + 1);
+                std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
+                uiInterface.InitMessage(strMsg);
+            }
         }
     }
     return true;
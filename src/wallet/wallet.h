@@ -45,6 +45,8 @@ extern bool fLargeWorkInvalidChainFound;
 
 //! -keypool default
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! Number of HD keys TopUpKeyPool derives and writes in one database transaction
+static const unsigned int KEYPOOL_BATCH_SIZE = 1000;
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
 //! -paytxfee will warn if called with a higher fee than this amount (in satoshis) per KB
@@ -577,6 +579,8 @@ private:
 
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, uint32_t nAccountIndex, bool fInternal /*= false*/);
+    /* HD derive nCount new child keys at once, writing them and the updated chain with walletdb */
+    void DeriveNewChildKeys(CWalletDB& walletdb, const CKeyMetadata& metadata, uint32_t nAccountIndex, bool fInternal, unsigned int nCount, std::vector<CPubKey>& vPubKeysRet);
 
 public:
     /*
@@ -733,6 +737,7 @@ public:
     bool GetKey(const CKeyID &address, CKey& keyOut) const;
     //! Adds a HDPubKey into the wallet(database)
     bool AddHDPubKey(const CExtPubKey &extPubKey, bool fInternal);
+    bool AddHDPubKeyWithDB(CWalletDB &walletdb, const CExtPubKey &extPubKey, bool fInternal);
     //! loads a HDPubKey into the wallets memory
     bool LoadHDPubKey(const CHDPubKey &hdPubKey);
     //! Adds a key to the store, and saves it to disk.
@@ -763,6 +768,7 @@ public:
     //! Adds a watch-only address to the store, and saves it to disk.
     bool AddWatchOnly(const CScript &dest);
     bool RemoveWatchOnly(const CScript &dest);
+    bool RemoveWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest);
     //! Adds a watch-only address to the store, without saving it to disk (used by LoadWallet)
     bool LoadWatchOnly(const CScript &dest);
 